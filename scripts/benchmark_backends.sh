@@ -0,0 +1,56 @@
+#!/bin/bash
+# Compares the hash table backends: sparse tables (default), flat open-addressing tables (-DuseFlat),
+# sparse tables of color classes instead of color sets (-DuseClasses), of color sets stored as short lists of
+# colors up to 7 colors (-DuseHybrid), sparse tables holding the singleton k-mers as well (-DuseUnified), and
+# sparse tables keyed by the hash bits below the table index instead of the k-mer (-DuseQuotient).
+# usage: benchmark_backends.sh <input list> [<further SANS arguments>]
+# Builds SANS with each backend (set CC to change the compiler flags of the makefile, e.g. a larger maxN, and
+# BACKENDS to choose among "sparse flat classes hybrid unified quotient"), and prints the number of
+# k-mers, the time to fill the tables, the k-mers inserted per second (the bases of the input, roughly), and the peak
+# memory per k-mer (the peak resident memory of the process, including the mapped input files).
+
+if [ $# -lt 1 ]; then
+    echo "usage: $0 <input list> [<further SANS arguments>]" >&2
+    exit 1
+fi
+
+DIR=$(cd "$(dirname "$0")/.." && pwd)
+CC=${CC:-"g++ -O3 -march=native -DmaxK=32 -DmaxN=13 -std=c++17"}
+INPUT=$1
+shift
+BUILD=$(mktemp -d)
+OUT=$(mktemp)
+
+# number of bases in the input files, the file names are relative to the folder of the list
+FOLDER=$(dirname "$INPUT")
+BASES=$(sed 's/^[^ ]*: //; s/!.*//' "$INPUT" | tr ' ;' '\n\n' | while read -r FILE; do
+    [ -n "$FILE" ] && gzip -cdf "$FOLDER/$FILE"
+done | grep -v '^[>@+]' | tr -cd 'ACGTacgt' | wc -c)
+
+printf "%-8s %12s %10s %12s %14s\n" "backend" "k-mers" "time" "inserts/s" "bytes/k-mer"
+for BACKEND in ${BACKENDS:-sparse flat classes hybrid unified quotient}; do
+    mkdir -p "$BUILD/$BACKEND"
+    cp -r "$DIR/makefile" "$DIR/src" "$BUILD/$BACKEND/"
+    case $BACKEND in
+        flat) FLAGS="-DuseFlat" ;;
+        classes) FLAGS="-DuseClasses" ;;
+        hybrid) FLAGS="-DuseHybrid" ;;
+        unified) FLAGS="-DuseUnified" ;;
+        quotient) FLAGS="-DuseQuotient" ;;
+        *) FLAGS="" ;;
+    esac
+    make -C "$BUILD/$BACKEND" CC="$CC $FLAGS" -j"$(nproc)" >/dev/null 2>&1 || { echo "$BACKEND: build failed" >&2; continue; }
+
+    # run SANS and report its peak resident memory (KiB) behind its output
+    python3 -c 'import resource, subprocess, sys
+subprocess.run(sys.argv[1:], stderr=subprocess.DEVNULL)
+print("peak", resource.getrusage(resource.RUSAGE_CHILDREN).ru_maxrss)' \
+        "$BUILD/$BACKEND/SANS" -i "$INPUT" -o "$OUT" -v "$@" | tr '\r' '\n' | grep -a "singleton k-mers)\|^peak" |
+    awk -v backend=$BACKEND -v bases="$BASES" '
+        /k-mers read/ { n = $1; t = $(NF-1); u = $NF; sub(/\(/, "", t); sub(/\)/, "", u);
+                        s = (u == "ms") ? t / 1000 : (u == "min") ? t * 60 : (u == "h") ? t * 3600 : t }
+        /^peak/ { kib = $2 }
+        END { printf "%-8s %12d %9.2fs %12.0f %14.1f\n", backend, n, s, (s > 0 ? bases / s : 0), (n > 0 ? kib * 1024 / n : 0) }'
+done
+
+rm -rf "$BUILD" "$OUT"
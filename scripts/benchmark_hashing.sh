@@ -0,0 +1,26 @@
+#!/bin/bash
+# Reports the quality of the k-mer and color hashes on the given genomes.
+# usage: benchmark_hashing.sh <input list> [<k-mer lengths, default "15 21 31">] [<further SANS arguments>]
+# Prints the "k-mers read", "Hash tables" and "Color table" lines of the verbose output for each k-mer length, i.e.,
+# the time to fill the tables, the size of the largest bin (shard) relative to the mean, and the fraction of keys
+# that collide, i.e., the keys beyond the first one per home bucket (the first bucket probed).
+# For a random hash, 1-(1-exp(-a))/a of the keys collide at load factor a, e.g., 21% at 0.5 (the maximum).
+
+if [ $# -lt 1 ]; then
+    echo "usage: $0 <input list> [<k-mer lengths>] [<further SANS arguments>]" >&2
+    exit 1
+fi
+
+DIR=$(dirname "$0")
+SANS=${SANS:-$DIR/../SANS}
+INPUT=$1
+LENGTHS=${2:-"15 21 31"}
+shift; shift
+OUT=$(mktemp)
+
+for K in $LENGTHS; do
+    echo "k=$K"
+    "$SANS" -i "$INPUT" -o "$OUT" -v -k "$K" "$@" 2>/dev/null | tr '\r' '\n' | grep -a "k-mers read\|Hash tables\|Color table"
+done
+
+rm -f "$OUT"
@@ -0,0 +1,26 @@
+#!/bin/bash
+# Compares the k-mer insertion time of locked (default) and sharded (--shard) hash tables.
+# usage: benchmark_insertion.sh <input list> [<thread counts, default "1 8 32 128">] [<further SANS arguments>]
+# Prints the "k-mers read" line of the verbose output for each configuration.
+
+if [ $# -lt 1 ]; then
+    echo "usage: $0 <input list> [<thread counts>] [<further SANS arguments>]" >&2
+    exit 1
+fi
+
+DIR=$(dirname "$0")
+SANS=${SANS:-$DIR/../SANS}
+INPUT=$1
+THREADS=${2:-"1 8 32 128"}
+shift; shift
+OUT=$(mktemp)
+
+for T in $THREADS; do
+    for MODE in "" "--shard"; do
+        printf "T=%-4s %-8s " "$T" "${MODE:-locked}"
+        # confirm thread counts above 64
+        yes yes | "$SANS" -i "$INPUT" -o "$OUT" -v -T "$T" $MODE "$@" 2>/dev/null | grep "k-mers read"
+    done
+done
+
+rm -f "$OUT"
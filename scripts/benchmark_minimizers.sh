@@ -0,0 +1,24 @@
+#!/bin/bash
+# Measures the k-mer extraction time for growing minimizer windows (-w).
+# usage: benchmark_minimizers.sh <input list> [<window sizes, default "1 5 10 20 50 100">] [<further SANS arguments>]
+# Prints the "k-mers read" line of the verbose output for each window size (1 = all k-mers, no minimizers).
+# The time per window should not grow with the window size, only the number of k-mers should shrink.
+
+if [ $# -lt 1 ]; then
+    echo "usage: $0 <input list> [<window sizes>] [<further SANS arguments>]" >&2
+    exit 1
+fi
+
+DIR=$(dirname "$0")
+SANS=${SANS:-$DIR/../SANS}
+INPUT=$1
+WINDOWS=${2:-"1 5 10 20 50 100"}
+shift; shift
+OUT=$(mktemp)
+
+for W in $WINDOWS; do
+    printf "w=%-4s " "$W"
+    "$SANS" -i "$INPUT" -o "$OUT" -v -w "$W" "$@" 2>/dev/null | grep "k-mers read"
+done
+
+rm -f "$OUT"
@@ -0,0 +1,49 @@
+#!/bin/bash
+# Measures the k-mer throughput (k-mers/s) of the insertion pipelines, i.e., for each quality mode, with and without
+# blacklist, and with and without reverse complements, optionally side by side with a second (e.g. older) binary.
+# usage: benchmark_pipelines.sh <input list> <blacklist file> [<further SANS arguments>]
+# Set SANS to the binary to measure (default: ../SANS) and BASE to a binary to compare with.
+# Prints the number of bases in the input (i.e., roughly the number of k-mers processed) divided by the time
+# of the "k-mers read" line of the verbose output. K-mers are qualified per file, so use reads for q > 1.
+
+if [ $# -lt 2 ]; then
+    echo "usage: $0 <input list> <blacklist file> [<further SANS arguments>]" >&2
+    exit 1
+fi
+
+DIR=$(dirname "$0")
+SANS=${SANS:-$DIR/../SANS}
+INPUT=$1
+BLACKLIST=$2
+shift; shift
+OUT=$(mktemp)
+
+# number of bases in the input files, the file names are relative to the folder of the list
+FOLDER=$(dirname "$INPUT")
+BASES=$(sed 's/^[^ ]*: //; s/!.*//' "$INPUT" | tr ' ;' '\n\n' | while read -r FILE; do
+    [ -n "$FILE" ] && gzip -cdf "$FOLDER/$FILE"
+done | grep -v '^[>@+]' | tr -cd 'ACGTacgt' | wc -c)
+
+# k-mers per second of one run, from the time of "<n> k-mers read. (...) (<time> <unit>)"
+rate() {
+    "$1" -i "$INPUT" -o "$OUT" -v "${@:2}" 2>/dev/null | grep "singleton k-mers)" |
+        awk -v n="$BASES" '{ t = $(NF-1); u = $NF; sub(/\(/, "", t); sub(/\)/, "", u);
+               s = (u == "ms") ? t / 1000 : (u == "min") ? t * 60 : (u == "h") ? t * 3600 : t;
+               if (s > 0) printf "%12.0f", n / s; else printf "%12s", "-" }'
+}
+
+printf "%-24s %12s" "pipeline" "k-mers/s"
+[ -n "$BASE" ] && printf " %12s" "base"
+echo
+for Q in 1 2 3; do
+    for B in "" "-B $BLACKLIST"; do
+        for R in "" "-n"; do
+            printf "%-24s " "q=$Q${B:+ blacklist}${R:+ forward}"
+            rate "$SANS" -q $Q $B $R "$@"
+            [ -n "$BASE" ] && printf " " && rate "$BASE" -q $Q $B $R "$@"
+            echo
+        done
+    done
+done
+
+rm -f "$OUT"
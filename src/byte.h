@@ -28,9 +28,12 @@
 #elif BIT_LENGTH <= 32
     #define STORAGE_BITS 32
     typedef uint_least32_t STORAGE_TYPE;
-#else // _LENGTH <= 64
+#elif BIT_LENGTH <= 64 || !defined(__SIZEOF_INT128__) || BIT_LENGTH > 128
     #define STORAGE_BITS 64
     typedef uint_least64_t STORAGE_TYPE;
+#else // _LENGTH <= 128, native 128-bit integers (e.g. k-mers up to k = 64), aligned as two words in the tables
+    #define STORAGE_BITS 128
+    typedef unsigned __int128 STORAGE_TYPE __attribute__((aligned(8)));
 #endif
 
 #if BIT_LENGTH <= 255
@@ -43,7 +46,11 @@
     typedef uint_fast64_t INDEX_TYPE;
 #endif
 
-#define MAX_STORAGE_BITS 64 // threshold to switch from single to array representation
+#if defined(__SIZEOF_INT128__)
+    #define MAX_STORAGE_BITS 128 // threshold to switch from single to array representation
+#else
+    #define MAX_STORAGE_BITS 64
+#endif
 #define ARRAY_LENGTH ((BIT_LENGTH / STORAGE_BITS) + (bool)(BIT_LENGTH % STORAGE_BITS))
 
 #if defined(__has_include)
@@ -92,6 +99,19 @@
     #endif
 #endif
 
+#if STORAGE_BITS == 128 // combine the 64-bit halves
+    #define _lo64(_X) ((uint64_t) (_X))
+    #define _hi64(_X) ((uint64_t) ((_X) >> 64))
+    #define _popcnt(_X) ((INDEX_TYPE) (__builtin_popcountll(_lo64(_X)) + __builtin_popcountll(_hi64(_X))))
+    #define _tzcnt(_X) ((INDEX_TYPE) (_lo64(_X)? __builtin_ctzll(_lo64(_X)): _hi64(_X)? 64+__builtin_ctzll(_hi64(_X)): 128))
+    #if defined(__BMI2__)
+        #define _pext(_X,_Y) (((STORAGE_TYPE) _pext_u64(_hi64(_X), _hi64(_Y)) << __builtin_popcountll(_lo64(_Y)))\
+                              | _pext_u64(_lo64(_X), _lo64(_Y)))
+        #define _pdep(_X,_Y) (((STORAGE_TYPE) _pdep_u64(_lo64((_X) >> __builtin_popcountll(_lo64(_Y))), _hi64(_Y)) << 64)\
+                              | _pdep_u64(_lo64(_X), _lo64(_Y)))
+    #endif
+#endif
+
 #if !defined(_popcnt)
     #define _popcnt(_X)\
     [] (const STORAGE_TYPE& X) -> INDEX_TYPE {\
@@ -585,7 +605,9 @@ class CLASS_NAME {
 // ############################# END CLASS DEFINITION ############################# //
 
 constexpr STORAGE_TYPE operator%(const STORAGE_TYPE& value) const noexcept {
-       #if BIT_LENGTH <= MAX_STORAGE_BITS
+       #if STORAGE_BITS == 128
+         return (_lo64(byte) ^ _hi64(byte)) % value;    // as for two words
+       #elif BIT_LENGTH <= MAX_STORAGE_BITS
          return byte % value;
        #else
          STORAGE_TYPE hash = byte[0];
@@ -597,13 +619,27 @@ constexpr STORAGE_TYPE operator%(const STORAGE_TYPE& value) const noexcept {
 };
 
 template<> struct std::hash<CLASS_NAME> {
-    constexpr STORAGE_TYPE operator()(const CLASS_NAME& obj) const noexcept {
-       #if BIT_LENGTH <= MAX_STORAGE_BITS
-         return obj.byte;
-       #else
-         STORAGE_TYPE hash = obj.byte[0];
+    // SplitMix64 finalizer, each input bit affects all output bits (low bits pick buckets, high bits pick shards)
+    static constexpr uint64_t mix(uint64_t x) noexcept {
+        x ^= x >> 30; x *= 0xbf58476d1ce4e5b9ULL;
+        x ^= x >> 27; x *= 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+    // the inverse of mix, e.g., to restore a single-word k-mer from its hash
+    static constexpr uint64_t unmix(uint64_t x) noexcept {
+        x ^= x >> 31 ^ x >> 62; x *= 0x319642b2d24d8ec3ULL;
+        x ^= x >> 27 ^ x >> 54; x *= 0x96de1b173f119089ULL;
+        return x ^ x >> 30 ^ x >> 60;
+    }
+    constexpr size_t operator()(const CLASS_NAME& obj) const noexcept {
+       #if STORAGE_BITS == 128
+         return mix(mix(_lo64(obj.byte)) ^ _hi64(obj.byte));    // as for two words
+       #elif BIT_LENGTH <= MAX_STORAGE_BITS
+         return mix(obj.byte);
+       #else
+         uint64_t hash = mix(obj.byte[0]);
          for (INDEX_TYPE i = 1; i != ARRAY_LENGTH; ++i)
-             hash ^= obj.byte[i];
+             hash = mix(hash ^ obj.byte[i]);    // chain the words, such that their order matters
          return hash;
        #endif
     }
@@ -618,6 +654,8 @@ template<> struct std::hash<CLASS_NAME> {
 #undef MAX_STORAGE_BITS
 #undef ARRAY_LENGTH
 
+#undef _lo64
+#undef _hi64
 #undef _popcnt
 #undef _tzcnt
 #undef _pext
@@ -112,3 +112,84 @@ bool color::is_singleton(const color_t& c){
 	return c.popcnt()==1;
 }
 
+
+/**
+ * This constructor stores a color set as a list, if it has few colors, or as a bitset.
+ *
+ * @param color bit sequence
+ */
+hybrid_color_t::hybrid_color_t(const color_t& color) {
+    if (color.popcnt() > list_size) {
+        size = dense; bits(new color_t(color));
+        return;
+    }
+    for (color_t rest = color; rest != 0; ++size) {    // the colors in ascending order
+        list[size] = rest.tzcnt();
+        rest.reset(list[size]);
+    }
+}
+
+hybrid_color_t::hybrid_color_t(const hybrid_color_t& other) : size(other.size) {
+    if (size == dense) bits(new color_t(*other.bits()));
+    else copy(other.list, other.list + size, list);
+}
+
+hybrid_color_t::hybrid_color_t(hybrid_color_t&& other) noexcept : size(other.size) {
+    copy(other.list, other.list + list_size, list);    // the list or the pointer to the bitset
+    other.size = 0;
+}
+
+hybrid_color_t& hybrid_color_t::operator=(hybrid_color_t other) noexcept {
+    swap(size, other.size);
+    swap(list, other.list);
+    return *this;
+}
+
+hybrid_color_t::~hybrid_color_t() {
+    if (size == dense) delete bits();
+}
+
+/**
+ * This function tests if a color is in the set.
+ *
+ * @param color color
+ * @return true, if the color is in the set
+ */
+bool hybrid_color_t::test(const uint16_t& color) const {
+    if (size == dense) return bits()->test(color);
+    return binary_search(list, list + size, color);
+}
+
+/**
+ * This function adds a color to the set, the list becomes a bitset if it is full.
+ *
+ * @param color color
+ */
+void hybrid_color_t::set(const uint16_t& color) {
+    if (size == dense) {
+        bits()->set(color);
+        return;
+    }
+    uint16_t* pos = lower_bound(list, list + size, color);
+    if (pos != list + size && *pos == color) return;    // already in the list
+    if (size < list_size) {    // insert into the sorted list
+        copy_backward(pos, list + size, list + size + 1);
+        *pos = color; ++size;
+    } else {    // the list is full -> bitset
+        color_t* bitset = new color_t(colors());
+        bitset->set(color);
+        size = dense; bits(bitset);
+    }
+}
+
+/**
+ * This function returns the color set as a bitset.
+ *
+ * @return bit sequence
+ */
+color_t hybrid_color_t::colors() const {
+    if (size == dense) return *bits();
+    color_t color;
+    for (uint16_t i = 0; i < size; ++i) color.set(list[i]);
+    return color;
+}
@@ -1,4 +1,6 @@
 #include <iostream>
+#include <cstring>
+#include <algorithm>
 using namespace std;
 
 #ifndef maxN     // max. color number defined
@@ -108,3 +110,78 @@ class color {
  protected:
 
 };
+
+/**
+ * This class stores a color set as a short sorted list of colors, and as a bitset (color_t) past list_size colors.
+ * Most k-mers occur in a few genomes only, so for a large maxN, the list saves most of the memory (-DuseHybrid).
+ */
+class hybrid_color_t {
+
+ public:
+
+    /**
+     * This is the max. number of colors in the list, i.e., the list and its size take 16 bytes.
+     */
+    static const uint16_t list_size = 7;
+
+    hybrid_color_t() = default;
+
+    /**
+     * This constructor stores a color set as a list, if it has few colors, or as a bitset.
+     *
+     * @param color bit sequence
+     */
+    explicit hybrid_color_t(const color_t& color);
+
+    hybrid_color_t(const hybrid_color_t& other);
+    hybrid_color_t(hybrid_color_t&& other) noexcept;
+    hybrid_color_t& operator=(hybrid_color_t other) noexcept;
+    ~hybrid_color_t();
+
+    /**
+     * This function tests if a color is in the set.
+     *
+     * @param color color
+     * @return true, if the color is in the set
+     */
+    bool test(const uint16_t& color) const;
+
+    /**
+     * This function adds a color to the set, the list becomes a bitset if it is full.
+     *
+     * @param color color
+     */
+    void set(const uint16_t& color);
+
+    /**
+     * This function returns the color set as a bitset.
+     *
+     * @return bit sequence
+     */
+    color_t colors() const;
+
+    /**
+     * This function tells if the color set is stored as a bitset.
+     *
+     * @return true, if stored as a bitset
+     */
+    bool is_dense() const {return size == dense;}
+
+    /**
+     * This function tells if the color set has a single color.
+     *
+     * @param color the single color
+     * @return true, if the set has a single color
+     */
+    bool is_singleton(uint16_t& color) const {color = list[0]; return size == 1;}
+
+ private:
+
+    static const uint16_t dense = UINT16_MAX;    // size of a color set stored as a bitset
+
+    uint16_t size = 0;    // number of colors in the list, or dense
+    uint16_t list[list_size];    // sorted colors, the last 8 bytes hold the pointer to the bitset if dense
+
+    color_t* bits() const {color_t* ptr; memcpy(&ptr, list + 3, sizeof(ptr)); return ptr;}
+    void bits(color_t* ptr) {memcpy(list + 3, &ptr, sizeof(ptr));}
+};
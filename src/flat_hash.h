@@ -0,0 +1,294 @@
+#ifndef SANS_FLAT_HASH_H
+#define SANS_FLAT_HASH_H
+
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__)
+    #include <immintrin.h>
+#endif
+
+using namespace std;
+
+/**
+ * This class is a flat open-addressing hash table in the style of SwissTable (-DuseFlat).
+ * The slots are stored in one array, next to an array of control bytes that are either empty, deleted,
+ * or hold 7 bits of the hash of the key in the slot. The slots are grouped by 16: a lookup compares the
+ * control bytes of a whole group at once (SSE2) and only touches the slots whose 7 bits match.
+ * Groups are probed quadratically, starting from the group given by the other bits of the hash.
+ * Compared to the sparse tables (tsl::sparse_map), it needs more memory, but no indirection per lookup.
+ *
+ * @tparam K key type
+ * @tparam S slot type, i.e., the key or a pair of key and value
+ * @tparam H hash function, which has to mix all bits (see byte.h)
+ */
+template <typename K, typename S, typename H = std::hash<K>>
+class flat_table {
+
+protected:
+
+    static constexpr uint64_t group_size = 16;    // slots per group, i.e., per SSE2 register of control bytes
+    static constexpr int8_t ctrl_empty = -128;    // 0b10000000
+    static constexpr int8_t ctrl_deleted = -2;    // 0b11111110, full slots are 0b0xxxxxxx
+
+    vector<int8_t> ctrl;    // control bytes, one per slot
+    vector<S> slots;    // keys (and values)
+    uint64_t entries = 0;    // number of keys
+    uint64_t tombstones = 0;    // number of deleted slots
+    uint64_t group_mask = 0;    // number of groups - 1
+
+    static const K& key_of(const K& slot) { return slot; }
+    template <typename V>
+    static const K& key_of(const pair<K, V>& slot) { return slot.first; }
+
+    // the slots of a group with the given control byte
+    static uint32_t match(const int8_t* group, int8_t byte) {
+       #if defined(__SSE2__)
+         __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(group));
+         return _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(byte)));
+       #else
+         uint32_t mask = 0;
+         for (uint64_t i = 0; i < group_size; ++i) mask |= (uint32_t) (group[i] == byte) << i;
+         return mask;
+       #endif
+    }
+
+    // the empty or deleted slots of a group
+    static uint32_t match_free(const int8_t* group) {
+       #if defined(__SSE2__)
+         __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(group));
+         return _mm_movemask_epi8(_mm_cmplt_epi8(bytes, _mm_set1_epi8(-1)));
+       #else
+         uint32_t mask = 0;
+         for (uint64_t i = 0; i < group_size; ++i) mask |= (uint32_t) (group[i] < -1) << i;
+         return mask;
+       #endif
+    }
+
+    // the slot of a key, or the number of slots if it is not in the table
+    uint64_t find_slot(const K& key, const uint64_t& hash) const {
+        if (entries == 0) return slots.size();
+        uint64_t group = (hash >> 7) & group_mask;
+        for (uint64_t step = 1; ; ++step) {
+            const int8_t* bytes = ctrl.data() + group * group_size;
+            for (uint32_t hits = match(bytes, hash & 0x7F); hits != 0; hits &= hits - 1) {
+                uint64_t slot = group * group_size + __builtin_ctz(hits);
+                if (key_of(slots[slot]) == key) return slot;
+            }
+            if (match(bytes, ctrl_empty) != 0) return slots.size();    // the key would have been placed here
+            group = (group + step) & group_mask;    // triangular numbers visit all groups
+        }
+    }
+
+    // the first empty or deleted slot on the probe sequence of a hash
+    uint64_t free_slot(const uint64_t& hash) const {
+        uint64_t group = (hash >> 7) & group_mask;
+        for (uint64_t step = 1; ; ++step) {
+            uint32_t free = match_free(ctrl.data() + group * group_size);
+            if (free != 0) return group * group_size + __builtin_ctz(free);
+            group = (group + step) & group_mask;
+        }
+    }
+
+    // places a new key (and value), which is not in the table yet
+    uint64_t place(S&& slot, const uint64_t& hash) {
+        if ((entries + tombstones + 1) * 8 > slots.size() * 7) {    // keep the load (incl. deleted slots) below 7/8
+            rehash((entries + 1) * 16 > slots.size() * 7 ? 2 * slots.size() : slots.size());    // or drop the deleted
+        }
+        uint64_t pos = free_slot(hash);
+        tombstones -= ctrl[pos] == ctrl_deleted;
+        ctrl[pos] = hash & 0x7F;
+        slots[pos] = std::move(slot);
+        ++entries;
+        return pos;
+    }
+
+    // removes the key of a full slot
+    void remove(const uint64_t& pos) {
+        uint64_t group = pos / group_size * group_size;
+        if (match(ctrl.data() + group, ctrl_empty) != 0) {
+            ctrl[pos] = ctrl_empty;    // no probe sequence continues behind a group with an empty slot
+        } else {
+            ctrl[pos] = ctrl_deleted;
+            ++tombstones;
+        }
+        slots[pos] = S();
+        --entries;
+    }
+
+    // moves all keys into a table of the given number of slots
+    void rehash(uint64_t size) {
+        size = max<uint64_t>(size, group_size);
+        vector<int8_t> old_ctrl(size, ctrl_empty);
+        vector<S> old_slots(size);
+        old_ctrl.swap(ctrl); old_slots.swap(slots);
+        group_mask = size / group_size - 1;
+        tombstones = 0;
+        for (uint64_t i = 0; i < old_slots.size(); ++i) {
+            if (old_ctrl[i] < 0) continue;
+            uint64_t hash = H()(key_of(old_slots[i]));
+            uint64_t pos = free_slot(hash);
+            ctrl[pos] = hash & 0x7F;
+            slots[pos] = std::move(old_slots[i]);
+        }
+    }
+
+    // the next full slot from the given one on
+    uint64_t next_full(uint64_t pos) const {
+        while (pos < ctrl.size() && ctrl[pos] < 0) ++pos;
+        return pos;
+    }
+
+public:
+
+    /**
+     * This class iterates the full slots of the table.
+     */
+    template <bool C>
+    class basic_iterator {
+        friend class flat_table;
+        using table_type = conditional_t<C, const flat_table, flat_table>;
+        table_type* table = nullptr;
+        uint64_t pos = 0;
+        basic_iterator(table_type* table, uint64_t pos) : table(table), pos(pos) {}
+
+      public:
+        using iterator_category = forward_iterator_tag;
+        using value_type = S;
+        using difference_type = ptrdiff_t;
+        using pointer = conditional_t<C, const S*, S*>;
+        using reference = conditional_t<C, const S&, S&>;
+
+        basic_iterator() = default;
+        basic_iterator(const basic_iterator<false>& it) : table(it.table), pos(it.pos) {}
+
+        reference operator*() const { return table->slots[pos]; }
+        pointer operator->() const { return &table->slots[pos]; }
+        const K& key() const { return key_of(table->slots[pos]); }    // the key of an entry (as tsl::sparse_map)
+        auto& value() const { return table->slots[pos].second; }    // the value of a map entry
+
+        basic_iterator& operator++() { pos = table->next_full(pos + 1); return *this; }
+        basic_iterator operator++(int) { basic_iterator it = *this; ++*this; return it; }
+        bool operator==(const basic_iterator& it) const { return pos == it.pos; }
+        bool operator!=(const basic_iterator& it) const { return pos != it.pos; }
+
+        friend class basic_iterator<!C>;
+    };
+
+    using key_type = K;
+    using value_type = S;
+    using size_type = size_t;
+    using iterator = basic_iterator<false>;
+    using const_iterator = basic_iterator<true>;
+
+    iterator begin() { return iterator(this, next_full(0)); }
+    iterator end() { return iterator(this, slots.size()); }
+    const_iterator begin() const { return const_iterator(this, next_full(0)); }
+    const_iterator end() const { return const_iterator(this, slots.size()); }
+
+    size_type size() const { return entries; }
+    bool empty() const { return entries == 0; }
+    size_type bucket_count() const { return slots.size(); }
+
+    iterator find(const K& key) { return iterator(this, find_slot(key, H()(key))); }
+    const_iterator find(const K& key) const { return const_iterator(this, find_slot(key, H()(key))); }
+    bool contains(const K& key) const { return find_slot(key, H()(key)) != slots.size(); }
+    size_type count(const K& key) const { return contains(key); }
+
+    /**
+     * This function inserts an entry, unless its key is in the table already.
+     *
+     * @param slot key (and value)
+     * @return the entry of the key, and whether it has been inserted
+     */
+    pair<iterator, bool> insert(const S& slot) {
+        uint64_t hash = H()(key_of(slot));
+        uint64_t pos = find_slot(key_of(slot), hash);
+        if (pos != slots.size()) return {iterator(this, pos), false};
+        return {iterator(this, place(S(slot), hash)), true};
+    }
+
+    size_type erase(const K& key) {
+        uint64_t pos = find_slot(key, H()(key));
+        if (pos == slots.size()) return 0;
+        remove(pos);
+        return 1;
+    }
+    iterator erase(const_iterator it) {
+        remove(it.pos);
+        return iterator(this, next_full(it.pos + 1));
+    }
+
+    void clear() {
+        if (entries == 0 && tombstones == 0) return;
+        fill(ctrl.begin(), ctrl.end(), ctrl_empty);
+        if constexpr (!is_trivially_destructible_v<S>) fill(slots.begin(), slots.end(), S());
+        entries = 0; tombstones = 0;
+    }
+
+    void reserve(size_type size) {
+        uint64_t slots_needed = group_size;
+        while (slots_needed * 7 < size * 8) slots_needed *= 2;
+        if (slots_needed > slots.size()) rehash(slots_needed);
+    }
+
+    /**
+     * This function tells the number of groups probed to find a key (1 = its home group).
+     *
+     * @param key key in the table
+     * @return number of groups probed
+     */
+    uint64_t probes(const K& key) const {
+        uint64_t hash = H()(key);
+        uint64_t target = find_slot(key, hash) / group_size;
+        uint64_t group = (hash >> 7) & group_mask;
+        uint64_t step = 1;
+        for (; group != target; ++step) group = (group + step) & group_mask;
+        return step;
+    }
+};
+
+/**
+ * This is a flat hash map, see flat_table.
+ */
+template <typename K, typename V, typename H = std::hash<K>>
+class flat_map : public flat_table<K, pair<K, V>, H> {
+    using base = flat_table<K, pair<K, V>, H>;
+
+public:
+
+    using mapped_type = V;
+
+    V& operator[](const K& key) {
+        uint64_t hash = H()(key);
+        uint64_t pos = this->find_slot(key, hash);
+        if (pos == this->slots.size()) pos = this->place(pair<K, V>(key, V()), hash);
+        return this->slots[pos].second;
+    }
+
+    pair<typename base::iterator, bool> emplace(const K& key, const V& value) {
+        return this->insert(pair<K, V>(key, value));
+    }
+};
+
+/**
+ * This is a flat hash set, see flat_table.
+ */
+template <typename K, typename H = std::hash<K>>
+class flat_set : public flat_table<K, K, H> {
+    using base = flat_table<K, K, H>;
+
+public:
+
+    pair<typename base::iterator, bool> emplace(const K& key) {
+        return this->insert(key);
+    }
+};
+
+#endif
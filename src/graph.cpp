@@ -4,6 +4,15 @@
 #include <mutex>
 #include <thread>
 #include <algorithm>
+#include <fstream>
+#include <cstring>
+
+#if !defined(_WIN32)
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
 
 /**
  * This is the size of the top list.
@@ -33,19 +42,25 @@ uint64_t graph::table_count;
 vector<spinlock> graph::lock;
 
 /**
- * This vector holds the carries of 2**i % table_count for fast distribution of binary represented kmers
+ * These are the batch queues used to route k-mers to the thread owning their hash table (--shard).
  */
-vector<uint_fast32_t> graph::period;
+bool graph::sharded;
+uint64_t graph::thread_count;
+vector<vector<kmer_batch<kmer_t>*>> graph::outbox;
+vector<vector<kmer_batch<kmerAmino_t>*>> graph::outbox_amino;
+vector<kmer_inbox<kmer_t>> graph::inbox;
+vector<kmer_inbox<kmerAmino_t>> graph::inbox_amino;
+atomic<uint64_t> graph::finished_threads;
 
 /**
  * This is vector of hash tables mapping k-mers to colors [O(1)].
  */
-vector<hash_map<kmer_t, color_t>> graph::kmer_table;
+vector<hash_map<kmer_key_t, kmer_color_t>> graph::kmer_table;
 
 /**
  * This is the amino equivalent.
  */ 
-vector<hash_map<kmerAmino_t, color_t>> graph::kmer_tableAmino;
+vector<hash_map<kmerAmino_t, kmer_color_t>> graph::kmer_tableAmino;
 
 /**
  * This is a hash table mapping colors to weights [O(1)].
@@ -72,10 +87,60 @@ hash_set<kmerAmino_t> graph::blacklist_amino;
 /**
  * This is vector of hash tables mapping k-mers to genomes to buffer a k-mer before adding to the kmer_table. If it is seen a second time, it is added. Otherwise the singleton k-mer is ignored
  */
-vector<hash_map<kmer_t, uint16_t>> graph::singleton_kmer_table;
+#if !defined(useUnified)
+vector<hash_map<kmer_key_t, uint16_t>> graph::singleton_kmer_table;
 vector<hash_map<kmerAmino_t, uint16_t>> graph::singleton_kmer_tableAmino;
-uint64_t graph::singleton_counters[maxN];
-spinlock graph::singleton_counters_locks[maxN];
+#endif
+vector<singleton_counter> graph::singleton_counters;
+
+/**
+ * This is the scheme to sample k-mers with a window, and the number of k-mers seen and sampled per thread.
+ */
+sampling_scheme graph::sampling = lex_minimizers;
+vector<sampling_counter> graph::sampling_counters;
+
+/**
+ * This is the max. hash value of a k-mer to be kept (scaled sketch), and the factor to rescale the k-mer counts of a split.
+ */
+uint64_t graph::scaled_bound = UINT64_MAX;
+uint32_t graph::weight_scale = 1;
+
+/**
+ * These are the numbers of k-mers only known from loaded split counts, i.e., not in the tables.
+ */
+uint64_t graph::loaded_kmers = 0;
+uint64_t graph::loaded_singleton_kmers = 0;
+
+/**
+ * These are the partitions of the k-mers on disk (--max-memory), the budget of the tables, and the buffers of each thread.
+ */
+bool graph::partitioned = false;
+uint64_t graph::max_memory = 0;
+vector<FILE*> graph::partition_files;
+vector<uint64_t> graph::partition_records;
+vector<spinlock> graph::partition_lock;
+vector<vector<vector<pair<kmer_t, uint16_t>>>> graph::partition_buffers;
+vector<vector<vector<pair<kmerAmino_t, uint16_t>>>> graph::partition_buffers_amino;
+
+/**
+ * This is the number of k-mers per (not yet represented) color set in the k-mer tables, if known from an index.
+ * While it is tracked, each thread records the changes of the color sets by adding k-mers.
+ */
+bool graph::track_colors = false;
+hash_map<color_t, uint64_t> graph::kmer_colors;
+vector<hash_map<color_t, int64_t>> graph::color_deltas;
+
+#if defined(useClasses)
+/**
+ * These are the color classes, i.e., the distinct color sets of the k-mers, and the transitions between them.
+ * Each thread records the changes of the number of k-mers per class.
+ */
+vector<color_t> graph::class_colors;
+hash_map<color_t, uint32_t> graph::class_ids;
+spinlock graph::class_lock;
+vector<hash_map<uint64_t, uint32_t>> graph::class_transitions;
+vector<vector<int64_t>> graph::class_deltas;
+#endif
 
 
 /**
@@ -101,12 +166,15 @@ multimap_<double, color_t> graph::split_list;
 vector<char> graph::allowedChars;
 
 /**
- * This function qualifies a k-mer and places it into the hash table.
+ * This table maps each allowed char to its binary code (or marks it to be skipped or invalid).
+ */
+uint_fast8_t graph::char_code[256];
+
+/**
+ * This is the way to qualify k-mers, and whether k-mers are looked up in the blacklist before.
  */
-function<void(const uint64_t& T, uint_fast32_t& bin, const kmer_t&, const uint16_t&)> graph::emplace_kmer;
-function<void(const uint64_t& T, uint_fast32_t& bin, const kmer_t&, const uint16_t&)> graph::emplace_kmer_tmp;
-function<void(const uint64_t& T, uint_fast32_t& bin, const kmerAmino_t&, const uint16_t&)> graph::emplace_kmer_amino;
-function<void(const uint64_t& T, uint_fast32_t& bin, const kmerAmino_t&, const uint16_t&)> graph::emplace_kmer_amino_tmp;
+insertion_mode graph::insertion = direct_insert;
+bool graph::blacklisted = false;
 
 /**
  * This is a comparison function extending std::bitset.
@@ -145,64 +213,51 @@ struct node* newSet(color_t taxa, double weight, vector<node*> subsets) {
  * @param t top list size
  * @param q_table coverage thresholds
  * @param quality global q or maximum among all q values
+ * @param thread_count the number of threads used for processing
+ * @param sharded route k-mers to the thread owning their hash table instead of locking
  */
 
-void graph::init(uint64_t& top_size, bool amino, vector<int>& q_table, int& quality, hash_set<kmer_t>& blacklist, hash_set<kmerAmino_t>& blacklist_amino, uint64_t& thread_count) {
+void graph::init(uint64_t& top_size, bool amino, vector<int>& q_table, int& quality, hash_set<kmer_t>& blacklist, hash_set<kmerAmino_t>& blacklist_amino, uint64_t& thread_count, bool sharded) {
     t = top_size;
     isAmino = amino;
+    graph::sharded = sharded;
+    graph::thread_count = thread_count;
+    singleton_counters = vector<singleton_counter> (thread_count);
+    sampling_counters = vector<sampling_counter> (thread_count);
+    color_deltas = vector<hash_map<color_t, int64_t>> (thread_count);
+  #if defined(useClasses)
+    class_transitions = vector<hash_map<uint64_t, uint32_t>> (thread_count);
+    class_deltas = vector<vector<int64_t>> (thread_count);
+    intern_class(color_t());    // class 0 is the empty color set
+  #endif
     if(!isAmino){
-
-        // Automatic table count
-        //    table_count = 45 * thread_count - 33; // Estimated scaling
-        //    table_count = table_count % 2 ? table_count : table_count + 1; // Ensure the table count is odd
-        table_count = (0b1u << 14) + 1;
-        
+        table_count = 0b1u << table_bits;    // bins are the high bits of the hash
 
         // Init base tables
-	    kmer_table = vector<hash_map<kmer_t, color_t>> (table_count);
-	    singleton_kmer_table = vector<hash_map<kmer_t, uint16_t>> (table_count);
+	    kmer_table = vector<hash_map<kmer_key_t, kmer_color_t>> (table_count);
+	  #if !defined(useUnified)
+	    singleton_kmer_table = vector<hash_map<kmer_key_t, uint16_t>> (table_count);
+	  #endif
 
         // Init the lock vector
 	    lock = vector<spinlock> (table_count);
 
-        // Precompute the period for fast shift update kmer binning in bitset representation 
-        #if (maxK > 32)     
-        uint_fast32_t last = 1 % table_count;
-        for (int i = 1; i <= 2*(kmer::k); i++)
-        {
-            // cout << last << endl;
-	        period.push_back(last);
-	        last = (2 * last) % table_count;
-        }
-        #endif
-
 	    graph::allowedChars.push_back('A');
         graph::allowedChars.push_back('C');
         graph::allowedChars.push_back('G');
         graph::allowedChars.push_back('T');
     }else{
-        // Automatic table count
-        //    table_count = 33 * thread_count + 33; // Estimated scaling
-        //    table_count = table_count % 2 ? table_count : table_count + 1; // Ensure the table count is odd
-        table_count = (0b1u << 14) + 1;
+        table_count = 0b1u << table_bits;    // bins are the high bits of the hash
 
         // Init amino tables
-        kmer_tableAmino = vector<hash_map<kmerAmino_t, color_t>> (table_count);
+        kmer_tableAmino = vector<hash_map<kmerAmino_t, kmer_color_t>> (table_count);
+      #if !defined(useUnified)
         singleton_kmer_tableAmino = vector<hash_map<kmerAmino_t, uint16_t>> (table_count);
+      #endif
 		
         // Init the mutex lock vector
         lock = vector<spinlock> (table_count);
 
-        // Precompute the period for fast shift update kmer binning in bitset representation 
-        #if (maxK > 12)     
-        uint64_t last = 1 % table_count;
-        for (int i = 1; i <= 5*(kmerAmino::k); i++)
-        {
-	        period.push_back(last);
-	        last = (2 * last) % table_count;
-        }
-        #endif
-
         graph::allowedChars.push_back('A');
         //graph::allowedChars.push_back('B');
         graph::allowedChars.push_back('C');
@@ -232,6 +287,27 @@ void graph::init(uint64_t& top_size, bool amino, vector<int>& q_table, int& qual
         graph::allowedChars.push_back('*');
     }
 
+    // Fill the code table for the allowed chars, case-insensitive
+    fill(char_code, char_code + 256, code_invalid);
+    for (char c : allowedChars) {
+        uint_fast8_t code = isAmino ? util::amino_char_to_bits(c) : util::char_to_bits(c);
+        char_code[(uint8_t) toupper(c)] = code;
+        char_code[(uint8_t) tolower(c)] = code;
+    }
+    char_code[(uint8_t) '\n'] = code_skip; // line breaks within a sequence
+
+    // Init the batch queues, one inbox per thread and one outbox per thread and owner
+    if (sharded) {
+        if (!isAmino) {
+            outbox = vector<vector<kmer_batch<kmer_t>*>> (thread_count, vector<kmer_batch<kmer_t>*> (thread_count, nullptr));
+            inbox = vector<kmer_inbox<kmer_t>> (thread_count);
+        } else {
+            outbox_amino = vector<vector<kmer_batch<kmerAmino_t>*>> (thread_count, vector<kmer_batch<kmerAmino_t>*> (thread_count, nullptr));
+            inbox_amino = vector<kmer_inbox<kmerAmino_t>> (thread_count);
+        }
+        finished_threads = 0;
+    }
+
     graph::quality = quality;
     graph::q_table = q_table;
 	graph::blacklist = blacklist;
@@ -239,102 +315,18 @@ void graph::init(uint64_t& top_size, bool amino, vector<int>& q_table, int& qual
     switch (quality) {
     case 1:
 	case 0: /* no quality check */
-        emplace_kmer_tmp = [&] (const uint64_t& T, uint_fast32_t& bin, const kmer_t& kmer, const uint16_t& color) {
-            hash_kmer(bin, kmer, color);
-        };
-        emplace_kmer_amino_tmp = [&] (const uint64_t& T, uint_fast32_t& bin, const kmerAmino_t& kmer, const uint16_t& color) {
-            hash_kmer_amino(bin, kmer, color);
-        };
+        insertion = direct_insert;
         break;
-
     case 2:
         isAmino ? quality_setAmino.resize(thread_count) : quality_set.resize(thread_count);
-        if (q_table.size()>0){
-            emplace_kmer_tmp = [&] (const uint64_t& T, uint_fast32_t& bin, const kmer_t& kmer, const uint16_t& color) {
-                if (q_table[color]==1){
-                    hash_kmer(bin, kmer, color);
-                } else if (quality_set[T].find(kmer) == quality_set[T].end()) {
-                    quality_set[T].emplace(kmer);
-                } else {
-                    quality_set[T].erase(kmer);
-                    hash_kmer(bin, kmer, color);
-                }
-            };
-            emplace_kmer_amino_tmp = [&] (const uint64_t& T, uint_fast32_t& bin, const kmerAmino_t& kmer, const uint16_t& color) {
-                if (q_table[color]==1){
-                    hash_kmer_amino(bin, kmer, color);
-                } else if (quality_setAmino[T].find(kmer) == quality_setAmino[T].end()) {
-                    quality_setAmino[T].emplace(kmer);
-                } else {
-                    quality_setAmino[T].erase(kmer);
-                    hash_kmer_amino(bin, kmer, color);
-                }
-            };
-        } else { // global quality value (one if-clause fewer)
-            emplace_kmer_tmp = [&] (const uint64_t& T, uint_fast32_t& bin, const kmer_t& kmer, const uint16_t& color) {
-                if (quality_set[T].find(kmer) == quality_set[T].end()) {
-                    quality_set[T].emplace(kmer);
-                } else {
-                    quality_set[T].erase(kmer);
-                    hash_kmer(bin, kmer, color);
-                }
-            };
-            emplace_kmer_amino_tmp = [&] (const uint64_t& T, uint_fast32_t& bin, const kmerAmino_t& kmer, const uint16_t& color) {
-                if (quality_setAmino[T].find(kmer) == quality_setAmino[T].end()) {
-                    quality_setAmino[T].emplace(kmer);
-                } else {
-                    quality_setAmino[T].erase(kmer);
-                    hash_kmer_amino(bin, kmer, color);
-                }
-            };
-        }
+        insertion = q_table.size()>0 ? set_filter_table : set_filter;    // global quality value (one if-clause fewer)
         break;
     default:
         isAmino ? quality_mapAmino.resize(thread_count) : quality_map.resize(thread_count);
-        if (q_table.size()>0){
-            emplace_kmer_tmp = [&] (const uint64_t& T, uint_fast32_t& bin, const kmer_t& kmer, const uint16_t& color) {
-                if (quality_map[T][kmer] < q_table[color]-1) {
-                    quality_map[T][kmer]++;
-                } else {
-                    quality_map[T].erase(kmer);
-                    hash_kmer(bin, kmer, color);
-                }
-            };
-            emplace_kmer_amino_tmp = [&] (const uint64_t& T, uint_fast32_t& bin, const kmerAmino_t& kmer, const uint16_t& color) {
-                if (quality_mapAmino[T][kmer] < q_table[color]-1) {
-                    quality_mapAmino[T][kmer]++;
-                } else {
-                    quality_mapAmino[T].erase(kmer);
-                    hash_kmer_amino(bin, kmer, color);
-                }
-            };
-        }else { // global quality value
-            emplace_kmer_tmp = [&] (const uint64_t& T, uint_fast32_t& bin, const kmer_t& kmer, const uint16_t& color) {
-                if (quality_map[T][kmer] < quality-1) {
-                    quality_map[T][kmer]++;
-                } else {
-                    quality_map[T].erase(kmer);
-                    hash_kmer(bin, kmer, color);
-                }
-            };
-            emplace_kmer_amino_tmp = [&] (const uint64_t& T, uint_fast32_t& bin, const kmerAmino_t& kmer, const uint16_t& color) {
-                if (quality_mapAmino[T][kmer] < quality-1) {
-                    quality_mapAmino[T][kmer]++;
-                } else {
-                    quality_mapAmino[T].erase(kmer);
-                    hash_kmer_amino(bin, kmer, color);
-                }
-            };
-
-        }
+        insertion = q_table.size()>0 ? map_filter_table : map_filter;
         break;
     }
-	emplace_kmer = [&] (const uint64_t& T, uint_fast32_t& bin, const kmer_t& kmer, const uint16_t& color) {
-		emplace_kmer_tmp(T, bin, kmer, color);
-	};
-	emplace_kmer_amino = [&] (const uint64_t& T, uint_fast32_t& bin, const kmerAmino_t& kmer, const uint16_t& color) {
-		emplace_kmer_amino_tmp(T, bin, kmer, color);
-	};
+    blacklisted = false;
 }
 
 /**
@@ -342,244 +334,711 @@ void graph::init(uint64_t& top_size, bool amino, vector<int>& q_table, int& qual
  */
 void graph::activate_blacklist(){
     // Black list for kmers given?
-    if ((!isAmino && !blacklist.empty()) || (isAmino && !blacklist_amino.empty())) {
-		emplace_kmer = [&] (const uint64_t& T, uint_fast32_t& bin, const kmer_t& kmer, const uint16_t& color) {
-			// only add if kmer not in blacklist
-			if (graph::blacklist.find(kmer)==graph::blacklist.end()) {
-				emplace_kmer_tmp(T, bin, kmer, color);
-			}
-		};
-		emplace_kmer_amino = [&] (const uint64_t& T, uint_fast32_t& bin, const kmerAmino_t& kmer, const uint16_t& color) {
-			// only add if kmer not in blacklist
-			if (graph::blacklist_amino.find(kmer)==graph::blacklist_amino.end()) {
-				emplace_kmer_amino_tmp(T, bin, kmer, color);
-			}
-		};
-	}
+    blacklisted = (!isAmino && !blacklist.empty()) || (isAmino && !blacklist_amino.empty());
 }
 
+/**
+ * This function qualifies a k-mer and places it into the hash table.
+ *
+ * @param T the id of the current thread
+ * @param bin index of the target hash map
+ * @param kmer bit sequence
+ * @param color color flag
+ */
+template <insertion_mode Q, bool B>
+inline void graph::emplace_kmer(const uint64_t& T, uint_fast32_t& bin, const kmer_t& kmer, const uint16_t& color) {
+    if constexpr (B) {    // only add if kmer not in blacklist
+        if (blacklist.find(kmer) != blacklist.end()) return;
+    }
+    if constexpr (Q == direct_insert) {
+        hash_kmer(T, bin, kmer, color);
+    }
+    else if constexpr (Q == set_filter || Q == set_filter_table) {
+        if (Q == set_filter_table && q_table[color]==1) {
+            hash_kmer(T, bin, kmer, color);
+        } else if (quality_set[T].find(kmer) == quality_set[T].end()) {
+            quality_set[T].emplace(kmer);
+        } else {
+            quality_set[T].erase(kmer);
+            hash_kmer(T, bin, kmer, color);
+        }
+    }
+    else {
+        if (quality_map[T][kmer] < (Q == map_filter_table ? q_table[color] : quality)-1) {
+            quality_map[T][kmer]++;
+        } else {
+            quality_map[T].erase(kmer);
+            hash_kmer(T, bin, kmer, color);
+        }
+    }
+}
 
 /**
-* --- [Hash map access] ---
-* The following methods are used to access the entries of the vectorized hash maps
-*/ 
+ * This function qualifies an amino k-mer and places it into the hash table.
+ *
+ * @param T the id of the current thread
+ * @param bin index of the target hash map
+ * @param kmer bit sequence
+ * @param color color flag
+ */
+template <insertion_mode Q, bool B>
+inline void graph::emplace_kmer_amino(const uint64_t& T, uint_fast32_t& bin, const kmerAmino_t& kmer, const uint16_t& color) {
+    if constexpr (B) {    // only add if kmer not in blacklist
+        if (blacklist_amino.find(kmer) != blacklist_amino.end()) return;
+    }
+    if constexpr (Q == direct_insert) {
+        hash_kmer_amino(T, bin, kmer, color);
+    }
+    else if constexpr (Q == set_filter || Q == set_filter_table) {
+        if (Q == set_filter_table && q_table[color]==1) {
+            hash_kmer_amino(T, bin, kmer, color);
+        } else if (quality_setAmino[T].find(kmer) == quality_setAmino[T].end()) {
+            quality_setAmino[T].emplace(kmer);
+        } else {
+            quality_setAmino[T].erase(kmer);
+            hash_kmer_amino(T, bin, kmer, color);
+        }
+    }
+    else {
+        if (quality_mapAmino[T][kmer] < (Q == map_filter_table ? q_table[color] : quality)-1) {
+            quality_mapAmino[T][kmer]++;
+        } else {
+            quality_mapAmino[T].erase(kmer);
+            hash_kmer_amino(T, bin, kmer, color);
+        }
+    }
+}
 
 /**
- * This method shift-updates the bin of a kmer
+ * This function calls the given function with the insertion mode and blacklist as compile-time constants,
+ * such that the specialized pipeline is chosen once per sequence instead of once per k-mer.
+ *
+ * @param func generic function taking integral constants for the insertion mode and blacklist
  */
+template <typename F>
+static inline void dispatch_insertion(const insertion_mode& mode, const bool& blacklisted, F&& func) {
+    auto with_blacklist = [&] (auto Q) {
+        if (blacklisted) func(Q, std::true_type());
+        else func(Q, std::false_type());
+    };
+    switch (mode) {
+        case direct_insert: with_blacklist(integral_constant<insertion_mode, direct_insert>()); break;
+        case set_filter: with_blacklist(integral_constant<insertion_mode, set_filter>()); break;
+        case set_filter_table: with_blacklist(integral_constant<insertion_mode, set_filter_table>()); break;
+        case map_filter: with_blacklist(integral_constant<insertion_mode, map_filter>()); break;
+        case map_filter_table: with_blacklist(integral_constant<insertion_mode, map_filter_table>()); break;
+    }
+}
 
-uint_fast32_t graph::shift_update_bin(uint_fast32_t& bin, uint_fast8_t& left, uint_fast8_t& right)
-{
-        return (8 * table_count // Bias
-            + 4 * (bin - period[2*kmer::k-1] * (left / 2) - (left % 2) * period[2*kmer::k - 2]) // Shift
-            + period[1] * (right / 2) + period[0] * (right % 2)) // Update   
-            % table_count; // Mod
+/**
+ * This function qualifies a k-mer and places it into the hash table, choosing the pipeline at run time.
+ *
+ * @param T the id of the current thread
+ * @param bin index of the target hash map
+ * @param kmer bit sequence
+ * @param color color flag
+ */
+void graph::emplace_kmer(const uint64_t& T, uint_fast32_t& bin, const kmer_t& kmer, const uint16_t& color) {
+    dispatch_insertion(insertion, blacklisted, [&] (auto Q, auto B) {
+        emplace_kmer<Q(), B()>(T, bin, kmer, color);
+    });
+}
+
+/**
+ * This function qualifies an amino k-mer and places it into the hash table, choosing the pipeline at run time.
+ *
+ * @param T the id of the current thread
+ * @param bin index of the target hash map
+ * @param kmer bit sequence
+ * @param color color flag
+ */
+void graph::emplace_kmer_amino(const uint64_t& T, uint_fast32_t& bin, const kmerAmino_t& kmer, const uint16_t& color) {
+    dispatch_insertion(insertion, blacklisted, [&] (auto Q, auto B) {
+        emplace_kmer_amino<Q(), B()>(T, bin, kmer, color);
+    });
 }
 
 /**
- * This method shift updates the reverse complement bin of a kmer
+ * This function sets the scheme to sample k-mers with a window (see add_minimizers).
+ *
+ * @param scheme sampling scheme
  */
-uint_fast32_t graph::shift_update_rc_bin(uint_fast32_t& rc_bin, uint_fast8_t& left, uint_fast8_t& right)
-{   
-    // Remove
-    rc_bin += 8 * table_count - period[1] * (!(left / 2 )) - period[0] * (!(left % 2 ));
-    // First shift
-    if (rc_bin & 0b1u) {rc_bin += table_count;}
-    rc_bin >>= 1;
-    // Second shift
-    if (rc_bin & 0b1u) {rc_bin += table_count;}
-    rc_bin >>= 1;
-    // Update
-    rc_bin += (period[2*kmer::k-1] * (!(right / 2)) + period[2*kmer::k-2] * (!(right % 2)));
-    rc_bin %= table_count;
-    return rc_bin;
+void graph::init_sampling(sampling_scheme scheme) {
+    sampling = scheme;
 }
 
+/**
+ * This function tells the fraction of k-mers sampled with a window so far.
+ *
+ * @param kmers number of k-mers seen
+ * @param sampled number of k-mers sampled
+ * @return the sampling density, i.e., sampled / kmers
+ */
+double graph::sampling_density(uint64_t& kmers, uint64_t& sampled) {
+    kmers = 0; sampled = 0;
+    for (auto& counter : sampling_counters) {
+        kmers += counter.kmers;
+        sampled += counter.sampled;
+    }
+    return kmers > 0 ? (double) sampled / kmers : 0;
+}
 
 /**
- * This method shift-updates the bin of an amino kmer
+ * This function sets a scaled sketch: only the k-mers with a hash value below 2^64/scaled are kept.
+ * All genomes keep the same k-mers, so the shared k-mers of two genomes are reduced by the same fraction.
+ *
+ * @param scaled fraction 1/scaled of k-mers kept (1 keeps all k-mers)
+ * @param rescale multiply the k-mer counts of each split by scaled before weighting
  */
-uint_fast32_t graph::shift_update_amino_bin(uint_fast32_t& bin, kmerAmino_t& kmer, uint_fast8_t& right)
-{
-    // update the binning carry (solution of the shift-update-carry equation)
-    // shift
-    bin = 160 * table_count + // Bias 
-                32 * (bin // Shift
-                - kmer.test(5*kmerAmino::k - 1) * period[5*kmerAmino::k - 1]
-                - kmer.test(5*kmerAmino::k - 2) * period[5*kmerAmino::k - 2]
-                - kmer.test(5*kmerAmino::k - 3) * period[5*kmerAmino::k - 3]
-                - kmer.test(5*kmerAmino::k - 4) * period[5*kmerAmino::k - 4]
-                - kmer.test(5*kmerAmino::k - 5) * period[5*kmerAmino::k - 5]);
-    // update
-    for(int i = 4; i>=0; i--){
-        bin += period[i] * ((right >> i) & 0b1u);
-    }
-    // mod
-    bin %= table_count;
-    return bin;
-}
-
-/**
- * This method computes the bin of a given kmer(slower than shift update)
+void graph::init_scaled(uint64_t scaled, bool rescale) {
+    scaled_bound = scaled > 1 ? UINT64_MAX / scaled : UINT64_MAX;
+    weight_scale = rescale ? scaled : 1;
+}
+
+
+/**
+* --- [Hash map access] ---
+* The following methods are used to access the entries of the vectorized hash maps
+*/ 
+
+/**
+ * This method computes the bin of a given kmer from the high bits of its hash.
  * @param kmer The target kmer
  * @return uint64_t The bin
  */
-#if (maxK <= 32)
 uint_fast32_t graph::compute_bin(const kmer_t& kmer)
 {
-    return kmer % table_count;
+    return hash<kmer_t>()(kmer) >> (64 - table_bits);
 }
-#else
-uint_fast32_t graph::compute_bin(const kmer_t& kmer)
+
+/**
+ * This method computes the bin of a given amino kmer from the high bits of its hash.
+ * @param kmer The target kmer
+ * @return uint64_t The bin
+ */
+uint_fast32_t graph::compute_amino_bin(const kmerAmino_t& kmer)
 {
-	uint_fast32_t carry = 1;
-	uint_fast32_t rest = 0;
-	if (kmer.test(0)){rest++;} // Test the last bit
-	for (uint_fast32_t it=1; it < 2 * kmer::k; it++){
-	    carry = (2*carry) % table_count;
-	    if (kmer.test(it)){rest += carry;}
-	}
-	return rest % table_count;
+    return hash<kmerAmino_t>()(kmer) >> (64 - table_bits);
 }
-#endif
 
-#if maxK <= 12
-    uint_fast32_t graph::compute_amino_bin(const kmerAmino_t& kmer)
-    {
-        return kmer % table_count;
-    }
-#else
-    uint_fast32_t graph::compute_amino_bin(const kmerAmino_t& kmer)
-    {
-	    uint_fast32_t carry = 1;
-	    uint_fast32_t rest = 0;
+/**
+ * This method computes the key of a given kmer in its hash table, i.e., the low bits of its hash (-DuseQuotient).
+ * @param kmer The target kmer
+ * @return kmer_key_t The key
+ */
+kmer_key_t graph::compute_key(const kmer_t& kmer)
+{
+  #if defined(useQuotient)
+    static_assert(64 - table_bits <= 8 * sizeof(quotient_t::byte), "the key holds the bits of the hash below the bin");
+    return quotient_t(hash<kmer_t>()(kmer) & ((0b1ull << (64 - table_bits)) - 1));
+  #else
+    return kmer;
+  #endif
+}
+
+/**
+ * This method restores a kmer from the bin and the key in its hash table, i.e., by inverting its hash (-DuseQuotient).
+ * @param bin The bin
+ * @param key The key
+ * @return kmer_t The kmer
+ */
+kmer_t graph::restore_kmer(const uint_fast32_t& bin, const kmer_key_t& key)
+{
+  #if defined(useQuotient)
+    return kmer_t(hash<kmer_t>::unmix((uint64_t) bin << (64 - table_bits) | key.bits()));
+  #else
+    return key;
+  #endif
+}
 
-	    if (kmer.test(0)){rest++;} // Test the last bit
-	    for (uint_fast32_t it=1; it < 5* kmerAmino::k; it--){
-	        carry = (2*carry) % table_count;
-	        if (kmer.test(it)){rest += carry;}
-	    }
-	    return rest % table_count;
+
+/**
+ * This function writes the buffered records of a partition to its file, sorted and without duplicates.
+ * @param buffer records (k-mer and genome) of a thread
+ * @param file partition file
+ * @param lock lock of the partition file
+ * @param records number of records in the partition file, is increased
+ */
+template <typename K>
+static void flush_partition(vector<pair<K, uint16_t>>& buffer, FILE* file, spinlock& lock, uint64_t& records)
+{
+    sort(buffer.begin(), buffer.end());
+    buffer.erase(unique(buffer.begin(), buffer.end()), buffer.end());
+    vector<char> bytes(buffer.size() * (sizeof(K) + sizeof(uint16_t)));
+    char* pos = bytes.data();
+    for (auto& record : buffer) {
+        memcpy(pos, &record.first, sizeof(K)); pos += sizeof(K);
+        memcpy(pos, &record.second, sizeof(uint16_t)); pos += sizeof(uint16_t);
     }
-#endif
+    lock.lock();
+    bool written = fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+    records += buffer.size();
+    lock.unlock();
+    if (!written) {
+        cerr << "Error: could not write the k-mers to disk (--max-memory), no space left?" << endl;
+        exit(EXIT_FAILURE);
+    }
+    buffer.clear();
+}
 
+/**
+ * This function writes a k-mer and its genome to the partition of its bin (--max-memory).
+ * @param T The id of the current thread
+ * @param bin Index of the target hash map
+ * @param kmer The k-mer
+ * @param color The genome
+ */
+template <typename K>
+void graph::partition_kmer(const uint64_t& T, const uint_fast32_t& bin, const K& kmer, const uint16_t& color)
+{
+    uint64_t partition = bin >> (table_bits - partition_bits);    // the high bits of the bin
+    vector<pair<K, uint16_t>>* buffer;
+    if constexpr (is_same<K, kmer_t>::value) {buffer = &partition_buffers[T][partition];}
+    else {buffer = &partition_buffers_amino[T][partition];}
+    buffer->emplace_back(kmer, color);
+    if (buffer->size() >= partition_buffer) {
+        flush_partition(*buffer, partition_files[partition], partition_lock[partition], partition_records[partition]);
+    }
+}
 
 /**
 * This function hashes a k-mer and stores it in the correstponding hash table.
 * The corresponding table is chosen by the carry of the encoded k-mer given the number of tables as module.
+* If sharded, the k-mer is routed to the thread owning this table instead.
+* If partitioned (--max-memory), the k-mer is written to disk instead.
+*  @param T The id of the current thread
 *  @param kmer The kmer to store
 *  @param color The color to store 
 */
-void graph::hash_kmer(uint_fast32_t& bin, const kmer_t& kmer, const uint16_t& color)
+void graph::hash_kmer(const uint64_t& T, uint_fast32_t& bin, const kmer_t& kmer, const uint16_t& color)
+{
+    if (partitioned) {
+        partition_kmer(T, bin, kmer, color);
+        return;
+    }
+    if (sharded) {
+        route_kmer(T, bin, kmer, color);
+        return;
+    }
+    lock[bin].lock();
+    store_kmer(T, bin, kmer, color);
+    lock[bin].unlock();
+}
+
+
+/**
+ * This function hashes an amino k-mer and stores it in the corresponding hash table.
+ * The correspontind table is chosen by the carry of the encoded k-mer bitset by the bit-module function.
+ * If sharded, the k-mer is routed to the thread owning this table instead.
+ * If partitioned (--max-memory), the k-mer is written to disk instead.
+ * @param T The id of the current thread
+ * @param kmer The kmer to store
+ * @param color The color to store
+ */
+void graph::hash_kmer_amino(const uint64_t& T, uint_fast32_t& bin, const kmerAmino_t& kmer, const uint16_t& color)
 {
+    if (partitioned) {
+        partition_kmer(T, bin, kmer, color);
+        return;
+    }
+    if (sharded) {
+        route_kmer_amino(T, bin, kmer, color);
+        return;
+    }
     lock[bin].lock();
-	hash_map<kmer_t,color_t>::iterator entry=kmer_table[bin].find(kmer); 
+    store_kmer_amino(T, bin, kmer, color);
+    lock[bin].unlock();
+}
+
+
+#if defined(useClasses)
+/**
+ * This function returns the number of k-mers recorded for a color class, grown to cover new classes.
+ * @param deltas changes of the number of k-mers per color class
+ * @param id color class
+ * @return recorded number of k-mers
+ */
+static int64_t& class_delta(vector<int64_t>& deltas, const uint32_t& id)
+{
+    if (id >= deltas.size()) deltas.resize(id + 1);
+    return deltas[id];
+}
+
+/**
+ * This function returns the color class of a color set, a new one if the color set is not known yet.
+ * @param color The color set
+ * @return uint32_t The color class
+ */
+uint32_t graph::intern_class(const color_t& color)
+{
+    class_lock.lock();
+    auto entry = class_ids.emplace(color, class_colors.size());
+    if (entry.second) class_colors.push_back(color);
+    uint32_t id = entry.first->second;
+    class_lock.unlock();
+    return id;
+}
+
+/**
+ * This function tells the color class of the color set of a class with one more color (via the transition cache).
+ * @param T The id of the current thread
+ * @param id color class
+ * @param color color to add
+ * @return color class of the extended color set
+ */
+uint32_t graph::next_class(const uint64_t& T, const uint32_t& id, const uint16_t& color)
+{
+    hash_map<uint64_t, uint32_t>& cache = class_transitions[T];
+    uint64_t key = (uint64_t) id << 16 | color;
+    auto entry = cache.find(key);
+    if (entry != cache.end()) return entry->second;
+
+    class_lock.lock();    // the class table may grow meanwhile
+    color_t extended = class_colors[id];
+    class_lock.unlock();
+    uint32_t next = id;
+    if (!extended.test(color)) {
+        extended.set(color);
+        next = intern_class(extended);
+    }
+
+    if (cache.size() >= transition_limit) cache.clear();
+    cache.emplace(key, next);
+    return next;
+}
+#endif
+
+/**
+* This function stores a k-mer in the given hash table, the caller has to hold its lock or own it.
+*  @param bin Index of the target hash map
+*  @param kmer The kmer to store
+*  @param color The color to store 
+*/
+void graph::store_kmer(const uint64_t& T, const uint_fast32_t& bin, const kmer_t& kmer, const uint16_t& color)
+{
+	const kmer_key_t key = compute_key(kmer);    // the k-mer without the bits of its bin (-DuseQuotient)
+  #if defined(useUnified)
+	// not seen before? -> add as singleton, seen once before? -> promote in place
+	auto inserted = kmer_table[bin].emplace(key, singleton_value(color));
+	if(inserted.second){
+		singleton_counters[T].count[color]++;
+		return;
+	}
+	auto entry = inserted.first;
+	uint16_t single;
+	if(is_singleton(entry.value(), single)){
+		if(single != color){
+		  #if defined(useClasses)
+			uint32_t id = next_class(T, next_class(T, 0, single), color);
+			entry.value() = id;
+			class_delta(class_deltas[T], id)++;
+		  #else
+			entry.value().set(color);
+			if(track_colors){color_deltas[T][color_of(entry.value())]++;}
+		  #endif
+			singleton_counters[T].count[single]--;
+		}
+		return;
+	}
+  #else
+	hash_map<kmer_key_t,kmer_color_t>::iterator entry=kmer_table[bin].find(key); 
+  #endif
 	// already in the kmer table? -> add
 	if(entry != kmer_table[bin].end()){
-		entry.value().set(color);
+	  #if defined(useClasses)
+		uint32_t id = next_class(T, entry.value(), color);
+		if(id != entry.value()){ // move the k-mer to the class of its new color set
+			class_delta(class_deltas[T], entry.value())--;
+			class_delta(class_deltas[T], id)++;
+			entry.value() = id;
+		}
+	  #else
+		if(track_colors && !entry.value().test(color)){ // keep the color histogram up to date
+			color_deltas[T][color_of(entry.value())]--;
+			entry.value().set(color);
+			color_deltas[T][color_of(entry.value())]++;
+		} else {
+			entry.value().set(color);
+		}
+	  #endif
 	}
+  #if !defined(useUnified)
 	// not yet in the kmer table?
 	else{
-		hash_map<kmer_t,uint16_t>::iterator s_entry = singleton_kmer_table[bin].find(kmer);
+		hash_map<kmer_key_t,uint16_t>::iterator s_entry = singleton_kmer_table[bin].find(key);
  		//seen once before? -> add to kmer table / remove from singleton table
 		if(s_entry != singleton_kmer_table[bin].end()){
 			if(s_entry.value() != color){
-				kmer_table[bin][kmer].set(s_entry.value());
-				kmer_table[bin][kmer].set(color);
-				singleton_counters_locks[s_entry.value()].lock();
-				singleton_counters[s_entry.value()]--;
-				singleton_counters_locks[s_entry.value()].unlock();
+			  #if defined(useClasses)
+				uint32_t id = next_class(T, next_class(T, 0, s_entry.value()), color);
+				kmer_table[bin][key] = id;
+				class_delta(class_deltas[T], id)++;
+			  #else
+				kmer_color_t& promoted = kmer_table[bin][key];
+				promoted.set(s_entry.value());
+				promoted.set(color);
+				if(track_colors){color_deltas[T][color_of(promoted)]++;}
+			  #endif
+				singleton_counters[T].count[s_entry.value()]--;
 				singleton_kmer_table[bin].erase(s_entry);
 			}
 		}
 		// not seen before -> add to singleton_table
 		else{
-			singleton_kmer_table[bin][kmer]=color;
-			singleton_counters_locks[color].lock();
-			singleton_counters[color]++;
-			singleton_counters_locks[color].unlock();
+			singleton_kmer_table[bin][key]=color;
+			singleton_counters[T].count[color]++;
 		}
 	}
-    lock[bin].unlock();
+  #endif
 }
 
 
 /**
- * This function hashes an amino k-mer and stores it in the corresponding hash table.
- * The correspontind table is chosen by the carry of the encoded k-mer bitset by the bit-module function.
+ * This function stores an amino k-mer in the given hash table, the caller has to hold its lock or own it.
+ * @param bin Index of the target hash map
  * @param kmer The kmer to store
  * @param color The color to store
  */
-void graph::hash_kmer_amino(uint_fast32_t& bin, const kmerAmino_t& kmer, const uint16_t& color)
+void graph::store_kmer_amino(const uint64_t& T, const uint_fast32_t& bin, const kmerAmino_t& kmer, const uint16_t& color)
 {
-    lock[bin].lock();
-	hash_map<kmerAmino_t,color_t>::iterator entry=kmer_tableAmino[bin].find(kmer); 
+  #if defined(useUnified)
+	// not seen before? -> add as singleton, seen once before? -> promote in place
+	auto inserted = kmer_tableAmino[bin].emplace(kmer, singleton_value(color));
+	if(inserted.second){
+		singleton_counters[T].count[color]++;
+		return;
+	}
+	auto entry = inserted.first;
+	uint16_t single;
+	if(is_singleton(entry.value(), single)){
+		if(single != color){
+		  #if defined(useClasses)
+			uint32_t id = next_class(T, next_class(T, 0, single), color);
+			entry.value() = id;
+			class_delta(class_deltas[T], id)++;
+		  #else
+			entry.value().set(color);
+			if(track_colors){color_deltas[T][color_of(entry.value())]++;}
+		  #endif
+			singleton_counters[T].count[single]--;
+		}
+		return;
+	}
+  #else
+	hash_map<kmerAmino_t,kmer_color_t>::iterator entry=kmer_tableAmino[bin].find(kmer); 
+  #endif
 	// already in the kmer table? -> add
 	if(entry != kmer_tableAmino[bin].end()){
-		entry.value().set(color);
+	  #if defined(useClasses)
+		uint32_t id = next_class(T, entry.value(), color);
+		if(id != entry.value()){ // move the k-mer to the class of its new color set
+			class_delta(class_deltas[T], entry.value())--;
+			class_delta(class_deltas[T], id)++;
+			entry.value() = id;
+		}
+	  #else
+		if(track_colors && !entry.value().test(color)){ // keep the color histogram up to date
+			color_deltas[T][color_of(entry.value())]--;
+			entry.value().set(color);
+			color_deltas[T][color_of(entry.value())]++;
+		} else {
+			entry.value().set(color);
+		}
+	  #endif
 	}
+  #if !defined(useUnified)
 	// not yet in the kmer table?
 	else{
 		hash_map<kmerAmino_t,uint16_t>::iterator s_entry = singleton_kmer_tableAmino[bin].find(kmer);
  		//seen once before? -> add to kmer table / remove from singleton table
 		if(s_entry != singleton_kmer_tableAmino[bin].end()){
 			if(s_entry.value() != color){
-				kmer_tableAmino[bin][kmer].set(s_entry.value());
-				kmer_tableAmino[bin][kmer].set(color);
-				singleton_counters_locks[s_entry.value()].lock();
-				singleton_counters[s_entry.value()]--;
-				singleton_counters_locks[s_entry.value()].unlock();
+			  #if defined(useClasses)
+				uint32_t id = next_class(T, next_class(T, 0, s_entry.value()), color);
+				kmer_tableAmino[bin][kmer] = id;
+				class_delta(class_deltas[T], id)++;
+			  #else
+				kmer_color_t& promoted = kmer_tableAmino[bin][kmer];
+				promoted.set(s_entry.value());
+				promoted.set(color);
+				if(track_colors){color_deltas[T][color_of(promoted)]++;}
+			  #endif
+				singleton_counters[T].count[s_entry.value()]--;
 				singleton_kmer_tableAmino[bin].erase(s_entry);
 			}
 		}
 		// not seen before -> add to singleton_table
 		else{
 			singleton_kmer_tableAmino[bin][kmer]=color;
-			singleton_counters_locks[color].lock();
-			singleton_counters[color]++;
-			singleton_counters_locks[color].unlock();
+			singleton_counters[T].count[color]++;
 		}
-	}	
-    lock[bin].unlock();
+	}
+  #endif
 }
 
 /**
- * This function searches the corresponding hash table for the given kmer
- * @param kmer The kmer to search
+ * This function hands over a full batch to its owner by pushing it onto the owner's inbox.
+ * @param box the inbox of the owner
+ * @param batch the batch to hand over
  */
-bool graph::search_kmer(const kmer_t& kmer)
-{    
-    return kmer_table[compute_bin(kmer)].contains(kmer);
+template <typename K>
+static void publish_batch(kmer_inbox<K>& box, kmer_batch<K>* batch)
+{
+    batch->next = box.head.load(memory_order_relaxed);
+    while (!box.head.compare_exchange_weak(batch->next, batch, memory_order_release, memory_order_relaxed));
 }
 
-/** 
- * This function searches the correstponding hash table for the given amino kmer
- * @param kmer The amino kmer to search
- * @return bool Kmer exists as key in the corresponding map
+/**
+ * This function adds a k-mer to the batch of the thread owning its table.
+ * Each thread owns a contiguous range of tables, a full batch is handed over to the owner.
+ * @param T The id of the current thread
+ * @param bin Index of the target hash map
+ * @param kmer The kmer to route
+ * @param color The color to store
  */
-bool graph::search_kmer_amino(const kmerAmino_t& kmer)
+void graph::route_kmer(const uint64_t& T, const uint_fast32_t& bin, const kmer_t& kmer, const uint16_t& color)
 {
-    return kmer_tableAmino[compute_amino_bin(kmer)].contains(kmer);
+    uint64_t owner = bin * thread_count / table_count;
+    kmer_batch<kmer_t>*& batch = outbox[T][owner];
+    if (batch == nullptr) {
+        batch = new kmer_batch<kmer_t>();
+        batch->entries.reserve(batch_size);
+    }
+    batch->entries.push_back({kmer, bin, color});
+    if (batch->entries.size() >= batch_size) {
+        publish_batch(inbox[owner], batch);
+        batch = nullptr;
+        drain_inbox(T);    // insert the k-mers routed to this thread in the meantime
+    }
 }
 
-
 /**
-* This function returns the stored colores of the given kmer
-* @param kmer The target kmer
-* @return color_t The stored colores
-*/
-color_t graph::get_color(const kmer_t& kmer, bool reversed){
-    return kmer_table[compute_bin(kmer)][kmer];
+ * This function adds an amino k-mer to the batch of the thread owning its table.
+ * @param T The id of the current thread
+ * @param bin Index of the target hash map
+ * @param kmer The kmer to route
+ * @param color The color to store
+ */
+void graph::route_kmer_amino(const uint64_t& T, const uint_fast32_t& bin, const kmerAmino_t& kmer, const uint16_t& color)
+{
+    uint64_t owner = bin * thread_count / table_count;
+    kmer_batch<kmerAmino_t>*& batch = outbox_amino[T][owner];
+    if (batch == nullptr) {
+        batch = new kmer_batch<kmerAmino_t>();
+        batch->entries.reserve(batch_size);
+    }
+    batch->entries.push_back({kmer, bin, color});
+    if (batch->entries.size() >= batch_size) {
+        publish_batch(inbox_amino[owner], batch);
+        batch = nullptr;
+        drain_inbox(T);    // insert the k-mers routed to this thread in the meantime
+    }
 }
 
-
 /**
- * This function returns the stored color vector of the given amino kmer
- * @param kmer The target amino kmer
- * return color_t The stored color vector
+ * This function inserts all k-mers handed over to the given thread so far.
+ * Only the owner inserts into its tables, so no locks are needed.
+ * @param T The id of the owning thread
+ */
+void graph::drain_inbox(const uint64_t& T)
+{
+    if (!isAmino) {
+        kmer_batch<kmer_t>* batch = inbox[T].head.exchange(nullptr, memory_order_acquire);
+        while (batch != nullptr) {
+            for (auto& entry : batch->entries) {
+                store_kmer(T, entry.bin, entry.kmer, entry.color);
+            }
+            kmer_batch<kmer_t>* next = batch->next;
+            delete batch;
+            batch = next;
+        }
+    } else {
+        kmer_batch<kmerAmino_t>* batch = inbox_amino[T].head.exchange(nullptr, memory_order_acquire);
+        while (batch != nullptr) {
+            for (auto& entry : batch->entries) {
+                store_kmer_amino(T, entry.bin, entry.kmer, entry.color);
+            }
+            kmer_batch<kmerAmino_t>* next = batch->next;
+            delete batch;
+            batch = next;
+        }
+    }
+}
+
+/**
+ * This function hands over the partial batches of a thread and keeps inserting
+ * the k-mers routed to this thread until all threads have finished routing.
+ * @param T The id of the current thread
+ */
+void graph::finish_thread(const uint64_t& T)
+{
+    if (!sharded) return;
+    for (uint64_t owner = 0; owner < thread_count; ++owner) {
+        if (!isAmino && outbox[T][owner] != nullptr) {
+            publish_batch(inbox[owner], outbox[T][owner]);
+            outbox[T][owner] = nullptr;
+        }
+        if (isAmino && outbox_amino[T][owner] != nullptr) {
+            publish_batch(inbox_amino[owner], outbox_amino[T][owner]);
+            outbox_amino[T][owner] = nullptr;
+        }
+    }
+    finished_threads.fetch_add(1, memory_order_acq_rel);
+    while (true) {
+        bool last = finished_threads.load(memory_order_acquire) == thread_count;    // no more batches after this
+        drain_inbox(T);
+        if (last) break;
+        this_thread::yield();
+    }
+}
+
+/**
+ * This function searches the corresponding hash table for the given kmer
+ * @param kmer The kmer to search
+ */
+bool graph::search_kmer(const kmer_t& kmer)
+{    
+    return kmer_table[compute_bin(kmer)].contains(compute_key(kmer));
+}
+
+/** 
+ * This function searches the correstponding hash table for the given amino kmer
+ * @param kmer The amino kmer to search
+ * @return bool Kmer exists as key in the corresponding map
+ */
+bool graph::search_kmer_amino(const kmerAmino_t& kmer)
+{
+    return kmer_tableAmino[compute_amino_bin(kmer)].contains(kmer);
+}
+
+
+/**
+* This function returns the stored colores of the given kmer
+* @param kmer The target kmer
+* @return color_t The stored colores
+*/
+color_t graph::get_color(const kmer_t& kmer, bool reversed){
+    const kmer_color_t& value = kmer_table[compute_bin(kmer)][compute_key(kmer)];
+  #if defined(useUnified)
+    uint16_t single;
+    if (is_singleton(value, single)) {color_t color; color.set(single); return color;}
+  #endif
+    return color_of(value);
+}
+
+
+/**
+ * This function returns the stored color vector of the given amino kmer
+ * @param kmer The target amino kmer
+ * return color_t The stored color vector
  */
 color_t graph::get_color_amino(const kmerAmino_t& kmer){
-    return kmer_tableAmino[compute_amino_bin(kmer)][kmer];
+    const kmer_color_t& value = kmer_tableAmino[compute_amino_bin(kmer)][kmer];
+  #if defined(useUnified)
+    uint16_t single;
+    if (is_singleton(value, single)) {color_t color; color.set(single); return color;}
+  #endif
+    return color_of(value);
 }
 
 /**
@@ -587,7 +1046,21 @@ color_t graph::get_color_amino(const kmerAmino_t& kmer){
  * @param kmer The kmer to remove
  */
 void graph::remove_kmer(const kmer_t& kmer, bool reversed){
-    kmer_table[compute_bin(kmer)].erase(kmer);
+    auto& table = kmer_table[compute_bin(kmer)];
+    const kmer_key_t key = compute_key(kmer);
+  #if defined(useClasses) || defined(useUnified)
+    auto entry = table.find(key);
+    if (entry != table.end()) {
+      #if defined(useUnified)
+        uint16_t single;
+        if (is_singleton(entry.value(), single)) {singleton_counters[0].count[single]--; table.erase(key); return;}    // one singleton less
+      #endif
+      #if defined(useClasses)
+        class_delta(class_deltas[0], entry.value())--;    // one k-mer less in its class
+      #endif
+    }
+  #endif
+    table.erase(key);
 }
 
 
@@ -596,7 +1069,20 @@ void graph::remove_kmer(const kmer_t& kmer, bool reversed){
  * @param kmer The kmer to remove
  */
 void graph::remove_kmer_amino(const kmerAmino_t& kmer){
-    kmer_tableAmino[compute_amino_bin(kmer)].erase(kmer);
+    auto& table = kmer_tableAmino[compute_amino_bin(kmer)];
+  #if defined(useClasses) || defined(useUnified)
+    auto entry = table.find(kmer);
+    if (entry != table.end()) {
+      #if defined(useUnified)
+        uint16_t single;
+        if (is_singleton(entry.value(), single)) {singleton_counters[0].count[single]--; table.erase(kmer); return;}    // one singleton less
+      #endif
+      #if defined(useClasses)
+        class_delta(class_deltas[0], entry.value())--;    // one k-mer less in its class
+      #endif
+    }
+  #endif
+    table.erase(kmer);
 }
 
 /*
@@ -642,15 +1128,17 @@ void graph::fill_blacklist(string& str, bool& reverse) {
             right = util::char_to_bits(str[pos]);
             #if maxK <= 32
                 kmer::shift(kmer, right); // shift each base into the bit sequence
-                rcmer = kmer;
-	            if (reverse){
-                    kmer::reverse_complement(rcmer); // invert the k-mer
+                if (reverse) {
+                    kmer::shift_reverse(rcmer, right);    // shift the complement into the reverse complement
+                } else {
+                    rcmer = kmer;
                 }
             #else
                 kmer::shift(kmer, right); // shift each base into the bit sequence
-                rcmer = kmer;
-                if (reverse){
-                    kmer::reverse_complement(rcmer);
+                if (reverse) {
+                    kmer::shift_reverse(rcmer, right);    // shift the complement into the reverse complement
+                } else {
+                    rcmer = kmer;
                 }
             #endif
              // If the current word is a k-mer
@@ -683,175 +1171,281 @@ uint64_t graph::size_blacklist(){
 }
 
 
+/**
+ * This function orders k-mers by a hash value instead of lexicographically (see hash_minimizers, syncmers, and scaled sketches).
+ *
+ * @param kmer k-mer or s-mer
+ * @return the order of the k-mer
+ */
+static inline uint64_t order_hash(const kmer_t& kmer) {
+    return counter_rng::mix(hash<kmer_t>()(kmer));
+}
+static inline uint64_t order_hash(const kmerAmino_t& kmer) {
+    return counter_rng::mix(hash<kmerAmino_t>()(kmer));
+}
+
 /**
  * This function extracts k-mers from a sequence and adds them to the hash table.
+ * It is specialized for the insertion mode (Q), blacklist (B), and merging of complements (R).
  *
- * @param str dna sequence
+ * @param str dna sequence (upper or lower case, line breaks are skipped)
  * @param color color flag
- * @param reverse merge complements
  */
-void graph::add_kmers(uint64_t& T, string& str, uint16_t& color, bool& reverse) {
+template <insertion_mode Q, bool B, bool R>
+void graph::extract_kmers(uint64_t& T, string_view str, uint16_t& color) {
     if (str.length() < kmer::k) return;    // not enough characters
 
     uint_fast32_t bin = 0; // current hash_map vector index
-    uint_fast32_t rc_bin = 0; // current reverse hash_map vector index
 
     uint64_t pos;    // current position in the string, from 0 to length
-
+    uint64_t len = 0;    // number of consecutive valid characters up to the current position
     kmer_t kmer;    // create a new empty bit sequence for the k-mer
     kmer_t rcmer; // create a bit sequence for the reverse complement
 
-
-    uint_fast8_t left;  // The character that is shifted out 
     uint_fast8_t right; // The binary code of the character that is shifted in
 
-    #if maxK > 32
-    if (!isAmino){
-        for (int i =0; i < 2* kmer::k; i++){rc_bin += period[i];}
-        rc_bin %= table_count;
-    }
-    #endif
-
     kmerAmino_t kmerAmino=0;    // create a new empty bit sequence for the k-mer
 
-    uint64_t begin = 0;
-    
-    next_kmer:
-
-    pos = begin;
-    for (; pos < str.length(); ++pos) {    // collect the bases from the string
-        if (!isAllowedChar(pos, str)) {
-            begin = pos+1;    // str = str.substr(pos+1, string::npos);
-            goto next_kmer;    // unknown base, start a new k-mer from the beginning
-        }
-        // DNA processing 
-        if (!isAmino) {
-            right = util::char_to_bits(str[pos]);
-            #if maxK <= 32
-                kmer::shift(kmer, right); // shift each base into the bit sequence
-                rcmer = kmer;
-
-                bin = kmer % table_count; // update the forward bin
-	            if (reverse){
-                    kmer::reverse_complement(rcmer); // invert the k-mer
-                    rc_bin = rcmer % table_count;
+    // DNA processing, encoded in blocks of 64 characters
+    if (!isAmino) {
+        uint8_t codes[64];    // two-bit codes of the current block
+        uint64_t valid, skip;    // masks of the bases and line breaks in the current block
+
+        for (uint64_t block = 0; block < str.length(); block += 64) {
+            uint64_t n = min<uint64_t>(64, str.length() - block);
+            util::encode_dna(str.data() + block, n, codes, valid, skip);
+
+            uint64_t invalid = ~(valid | skip);    // unknown characters of the block
+            if (n < 64) invalid &= (1ULL << n) - 1;
+
+            for (uint64_t bases = valid; bases != 0; bases &= bases - 1) {    // jump from base to base
+                uint64_t i = __builtin_ctzll(bases);
+                uint64_t before = (bases & -bases) - 1;    // the characters in front of the base
+                if (invalid & before) {
+                    len = 0;    // unknown character, start a new k-mer from the beginning
+                    invalid &= ~before;
                 }
-            #else
-                left = 2*kmer.test(2*kmer::k-1)+kmer.test(2*kmer::k-2); // old leftmost character
-                bin = shift_update_bin(bin, left, right); // Shift update the forward complement bin
-                
+                ++len;
+                right = codes[i];
                 kmer::shift(kmer, right); // shift each base into the bit sequence
-                rcmer = kmer;
-                if (reverse){
-                    kmer::reverse_complement(rcmer);
-                    rc_bin = shift_update_rc_bin(rc_bin, left, right);  // Update the reverse complement table index
+                if constexpr (R) {
+                    kmer::shift_reverse(rcmer, right);    // shift the complement into the reverse complement
+                } else {
+                    rcmer = kmer;
+                }
+                // If the current word is a k-mer (and part of the sketch)
+                if (len >= kmer::k) {
+                    const kmer_t& cmer = rcmer < kmer ? rcmer : kmer;    // canonical k-mer
+                    if (scaled_bound == UINT64_MAX || order_hash(cmer) <= scaled_bound) {
+                        bin = compute_bin(cmer);    // only the inserted k-mer is hashed
+                        emplace_kmer<Q, B>(T, bin, cmer, color);
+                    }
                 }
-            #endif
-             // If the current word is a k-mer
-            if (pos+1 - begin >= kmer::k) {
-                rcmer < kmer ? emplace_kmer(T, rc_bin, rcmer, color) : emplace_kmer(T, bin, kmer, color);
-            }
-        
-        // Amino processing
-        } else {
-            right = util::amino_char_to_bits(str[pos]);
-            #if maxK <= 12
-                kmerAmino::shift_right(kmerAmino, str[pos]);    // shift each base into the bit sequence
-                bin = kmerAmino % table_count;
-            #else
-                bin = shift_update_amino_bin(bin, kmerAmino, right);
-                kmerAmino::shift_right(kmerAmino, str[pos]);
-            #endif
-            // The current word is a k-mer
-            if (pos+1 - begin >= kmerAmino::k) {
-                // shift update the bin
-                // Insert the k-mer into its table
-                emplace_kmer_amino(T, bin, kmerAmino, color);  // update the k-mer with the current color
             }
+            if (invalid) len = 0;    // unknown character behind the last base
         }
+        return;
     }
-    
 
+    // Amino processing
+    for (pos = 0; pos < str.length(); ++pos) {    // collect the bases from the string
+        right = char_code[(uint8_t) str[pos]];
+        if (right == code_skip) continue;    // line break, the k-mer continues on the next line
+        if (right == code_invalid) {
+            len = 0;    // unknown base, start a new k-mer from the beginning
+            continue;
+        }
+        ++len;
+        kmerAmino::shift_right(kmerAmino, right);    // shift each base into the bit sequence
+        // The current word is a k-mer (and part of the sketch)
+        if (len >= kmerAmino::k && (scaled_bound == UINT64_MAX || order_hash(kmerAmino) <= scaled_bound)) {
+            // Insert the k-mer into its table
+            bin = compute_amino_bin(kmerAmino);
+            emplace_kmer_amino<Q, B>(T, bin, kmerAmino, color);  // update the k-mer with the current color
+        }
+    }
 }
 
 /**
- * This function extracts k-mer minimizers from a sequence and adds them to the hash table.
+ * This function samples k-mers from a sequence with a window of m k-mers and adds them to the hash table.
+ * Minimizers are added once per occurrence, i.e., when they become the minimum of the sliding window.
+ * Syncmers are the k-mers whose first (open) or first or last (closed) s-mer (s = k-m+1) is a smallest one,
+ * i.e., they are selected independently of the surrounding sequence and of the strand.
+ * It is specialized for the insertion mode (Q), blacklist (B), and merging of complements (R).
  *
- * @param str dna sequence
+ * @param str dna sequence (upper or lower case, line breaks are skipped)
  * @param color color flag
- * @param reverse merge complements
  * @param m number of k-mers to minimize
  */
-void graph::add_minimizers(uint64_t& T, string& str, uint16_t& color, bool& reverse, uint64_t& m) {
+template <insertion_mode Q, bool B, bool R>
+void graph::extract_minimizers(uint64_t& T, string_view str, uint16_t& color, uint64_t& m) {
     if (str.length() < (!isAmino ? kmer::k : kmerAmino::k)) return;    // not enough characters
 
-    vector<kmer_t> sequence_order;    // k-mers ordered by their position in sequence
-    multiset<kmer_t> value_order;    // k-mers ordered by their lexicographical value
-
-    vector<kmerAmino_t> sequence_order_Amino;    // k-mers ordered by their position in sequence
-    multiset<kmerAmino_t> value_order_Amino;    // k-mers ordered by their lexicographical value
+    uint_fast32_t bin;    // hash_map vector index of the sampled k-mer
 
-    uint64_t pos;    // current position in the string, from 0 to length
+    uint64_t len = 0;    // number of consecutive valid characters up to the current position
+    uint_fast8_t right;    // The binary code of the character that is shifted in
     kmer_t kmer;    // create a new empty bit sequence for the k-mer
     kmer_t rcmer;    // create a bit sequence for the reverse complement
 
     kmerAmino_t kmerAmino=0;    // create a new empty bit sequence for the k-mer
 
-    uint64_t begin = 0;
-next_kmer:
-    pos = begin;
-    sequence_order.clear();
-    sequence_order_Amino.clear();
-    value_order.clear();
-    sequence_order_Amino.clear();
-    
-    uint_fast32_t bin = 0;
-    uint_fast32_t amino_bin = 0;
+    uint64_t kmers = 0;    // number of k-mers seen
+    uint64_t sampled = 0;    // number of k-mers sampled
+    bool syncmers = sampling == open_syncmers || sampling == closed_syncmers;
+    uint64_t s = (!isAmino ? kmer::k : kmerAmino::k) + 1 - m;    // s-mer length of syncmers
 
-    for (; pos < str.length(); ++pos) {    // collect the bases from the string
-        if (!isAllowedChar(pos, str)) {
-            begin = pos+1;    // str = str.substr(pos+1, string::npos);
-            goto next_kmer;    // unknown base, start a new k-mer from the beginning
+    if (!isAmino) {
+        minimizer_window<kmer_t> lex_window(m);    // canonical k-mers of the current window
+        minimizer_window<kmer_t, uint64_t> hash_window(m);    // canonical k-mers of the current window, by hash value
+        minimizer_window<kmer_t, uint64_t> smer_window(m);    // canonical s-mers of the current k-mer, by hash value
+        vector<uint64_t> smer_order(m);    // hash values of the s-mers of the current k-mer
+        uint64_t smers = 0;    // number of consecutive s-mers
+        kmer_t smask = 0b0u;    // bit-mask of the last s bases
+        for (uint64_t i = 0; syncmers && i < s; ++i) (smask <<= 02u) |= 0b11u;
+        kmer_t smer_complement[4];    // complements of the bases at the leftmost position of an s-mer
+        for (uint_fast8_t base = 0; syncmers && base < 4; ++base) {
+            smer_complement[base] = 0b11u - base;
+            for (uint64_t i = 1; i < s; ++i) smer_complement[base] <<= 02u;
         }
-        if (!isAmino) {
-            kmer::shift(kmer, str[pos]);    // shift each base into the bit sequence
-
-            if (pos+1 - begin >= kmer::k) {
+        kmer_t smer, rcsmer;
+
+        for (uint64_t pos = 0; pos < str.length(); ++pos) {    // collect the bases from the string
+            right = char_code[(uint8_t) str[pos]];
+            if (right == code_skip) continue;    // line break, the k-mer continues on the next line
+            if (right == code_invalid) {
+                len = 0;    // unknown base, start a new window from the beginning
+                lex_window.clear(); hash_window.clear(); smer_window.clear(); smers = 0;
+                continue;
+            }
+            ++len;
+            kmer::shift(kmer, right);    // shift each base into the bit sequence
+            if constexpr (R) {
+                kmer::shift_reverse(rcmer, right);    // shift the complement into the reverse complement
+            } else {
                 rcmer = kmer;
-		        // Test for multitables
-		        bool reversed = false;
-                if (reverse) {reversed = kmer::reverse_represent(rcmer);}    // invert the k-mer, if necessary
-
-                if (sequence_order.size() == m) {
-                    value_order.erase(*sequence_order.begin());    // remove k-mer outside the window
-                    sequence_order.erase(sequence_order.begin());
-                }
-                value_order.emplace(rcmer);    // insert k-mer ordered by its lexicographical value
-                sequence_order.emplace_back(rcmer);
-
-                if (sequence_order.size() == m) {
-                    bin = compute_bin(*value_order.begin());
-                    emplace_kmer(T, bin, *value_order.begin(), color);    // update the k-mer with the current color
-                }
             }
-        } else {
-            kmerAmino::shift_right(kmerAmino, str[pos]);    // shift each base into the bit sequence
-            bin = compute_amino_bin(kmerAmino);
-            if (pos+1 - begin >= kmerAmino::k) {
-                if (sequence_order.size() == m) {
-                    value_order_Amino.erase(*sequence_order_Amino.begin());    // remove k-mer outside the window
-                    sequence_order_Amino.erase(sequence_order_Amino.begin());
-                }
-                value_order_Amino.emplace(kmerAmino);    // insert k-mer ordered by its lexicographical value
-                sequence_order_Amino.emplace_back(kmerAmino);
-
-                if (sequence_order_Amino.size() == m) {
-                    // Update the minimizer in the corresponding table
-                    emplace_kmer_amino(T, bin, *value_order_Amino.begin(), color);    // update the k-mer with the current color
-                }
+            if (syncmers && R) {    // reverse complement of the last s-mer, shifted like rcmer
+                rcsmer >>= 02u;
+                rcsmer |= smer_complement[right];
+            }
+            if (syncmers && len >= s) {
+                smer = kmer; smer &= smask;    // last s-mer of the k-mer
+                if (R && rcsmer < smer) smer = rcsmer;
+                smer_order[smers++ % m] = order_hash(smer);
+                smer_window.push(smer, smer_order[(smers-1) % m]);
+            }
+            if (len < kmer::k) continue;
+
+            ++kmers;
+            bool forward = !(rcmer < kmer);
+            const kmer_t& cmer = forward ? kmer : rcmer;    // canonical k-mer
+            switch (sampling) {
+                case lex_minimizers:
+                    if (lex_window.push(cmer)) {
+                        bin = compute_bin(lex_window.kmer()); ++sampled;
+                        emplace_kmer<Q, B>(T, bin, lex_window.kmer(), color);    // update the minimizer with the current color
+                    }
+                    break;
+                case hash_minimizers:
+                    if (hash_window.push(cmer, order_hash(cmer))) {
+                        bin = compute_bin(hash_window.kmer()); ++sampled;
+                        emplace_kmer<Q, B>(T, bin, hash_window.kmer(), color);    // update the minimizer with the current color
+                    }
+                    break;
+                default:    // is the first (or last) s-mer of the canonical k-mer a smallest one?
+                    bool first = smer_order[smers % m] == smer_window.order();
+                    bool last = smer_order[(smers-1) % m] == smer_window.order();
+                    if ((forward ? first : last) || (sampling == closed_syncmers && (first || last))) {
+                        bin = compute_bin(cmer); ++sampled;
+                        emplace_kmer<Q, B>(T, bin, cmer, color);    // update the syncmer with the current color
+                    }
+            }
+        }
+    } else {
+        minimizer_window<kmerAmino_t> lex_window(m);    // k-mers of the current window
+        minimizer_window<kmerAmino_t, uint64_t> hash_window(m);    // k-mers of the current window, by hash value
+        minimizer_window<kmerAmino_t, uint64_t> smer_window(m);    // s-mers of the current k-mer, by hash value
+        vector<uint64_t> smer_order(m);    // hash values of the s-mers of the current k-mer
+        uint64_t smers = 0;    // number of consecutive s-mers
+        kmerAmino_t smask = 0b0u;    // bit-mask of the last s characters
+        for (uint64_t i = 0; syncmers && i < s; ++i) (smask <<= 05u) |= 0b11111u;
+        kmerAmino_t smer;
+
+        for (uint64_t pos = 0; pos < str.length(); ++pos) {    // collect the bases from the string
+            right = char_code[(uint8_t) str[pos]];
+            if (right == code_skip) continue;    // line break, the k-mer continues on the next line
+            if (right == code_invalid) {
+                len = 0;    // unknown base, start a new window from the beginning
+                lex_window.clear(); hash_window.clear(); smer_window.clear(); smers = 0;
+                continue;
+            }
+            ++len;
+            kmerAmino::shift_right(kmerAmino, right);    // shift each base into the bit sequence
+            if (syncmers && len >= s) {
+                smer = kmerAmino; smer &= smask;    // last s-mer of the k-mer
+                smer_order[smers++ % m] = order_hash(smer);
+                smer_window.push(smer, smer_order[(smers-1) % m]);
+            }
+            if (len < kmerAmino::k) continue;
+
+            ++kmers;
+            switch (sampling) {
+                case lex_minimizers:
+                    if (lex_window.push(kmerAmino)) {
+                        bin = compute_amino_bin(lex_window.kmer()); ++sampled;
+                        emplace_kmer_amino<Q, B>(T, bin, lex_window.kmer(), color);    // update the minimizer with the current color
+                    }
+                    break;
+                case hash_minimizers:
+                    if (hash_window.push(kmerAmino, order_hash(kmerAmino))) {
+                        bin = compute_amino_bin(hash_window.kmer()); ++sampled;
+                        emplace_kmer_amino<Q, B>(T, bin, hash_window.kmer(), color);    // update the minimizer with the current color
+                    }
+                    break;
+                default:    // is the first (or last) s-mer of the k-mer a smallest one?
+                    bool first = smer_order[smers % m] == smer_window.order();
+                    bool last = smer_order[(smers-1) % m] == smer_window.order();
+                    if (first || (sampling == closed_syncmers && last)) {
+                        bin = compute_amino_bin(kmerAmino); ++sampled;
+                        emplace_kmer_amino<Q, B>(T, bin, kmerAmino, color);    // update the syncmer with the current color
+                    }
             }
         }
     }
+    sampling_counters[T].kmers += kmers;
+    sampling_counters[T].sampled += sampled;
+}
+
+/**
+ * This function extracts k-mers from a sequence and adds them to the hash table.
+ * The specialized pipeline is chosen once for the whole sequence.
+ *
+ * @param str dna sequence (upper or lower case, line breaks are skipped)
+ * @param color color flag
+ * @param reverse merge complements
+ */
+void graph::add_kmers(uint64_t& T, string_view str, uint16_t& color, bool& reverse) {
+    dispatch_insertion(insertion, blacklisted, [&] (auto Q, auto B) {
+        reverse ? extract_kmers<Q(), B(), true>(T, str, color)
+                : extract_kmers<Q(), B(), false>(T, str, color);
+    });
+}
+
+/**
+ * This function samples k-mers from a sequence with a window of m k-mers and adds them to the hash table.
+ * The specialized pipeline is chosen once for the whole sequence.
+ *
+ * @param str dna sequence (upper or lower case, line breaks are skipped)
+ * @param color color flag
+ * @param reverse merge complements
+ * @param m number of k-mers to minimize
+ */
+void graph::add_minimizers(uint64_t& T, string_view str, uint16_t& color, bool& reverse, uint64_t& m) {
+    dispatch_insertion(insertion, blacklisted, [&] (auto Q, auto B) {
+        reverse ? extract_minimizers<Q(), B(), true>(T, str, color, m)
+                : extract_minimizers<Q(), B(), false>(T, str, color, m);
+    });
 }
 
 /**
@@ -1310,7 +1904,9 @@ void graph::add_cdbg_colored_kmer(string kmer_seq, const uint16_t& kmer_color){
 	    bool reversed = kmer::reverse_represent(kmer);
 
 		uint_fast32_t bin = compute_bin(kmer);
-		hash_kmer(bin, kmer, kmer_color);    // update the k-mer with the current color
+		lock[bin].lock();
+		store_kmer(0, bin, kmer, kmer_color);    // update the k-mer with the current color
+		lock[bin].unlock();
 
 }
 
@@ -1332,54 +1928,130 @@ void graph::add_weights(double mean(uint32_t&, uint32_t&), double min_value, boo
 	
 	
     //double min_value = numeric_limits<double>::min(); // current min. weight in the top list (>0)
-    uint64_t cur=0, prog=0, next;
+
+  #if defined(useClasses)
+    // The color sets in the tables are the color classes, no need to iterate the tables
+    vector<uint64_t> counts = class_counts();
+    for (uint64_t id = 0; id < counts.size(); ++id) {
+        if (counts[id] == 0) continue;    // all k-mers of this class have been extended
+        color_t color = class_colors[id];
+        bool pos = color::represent(color);    // invert the color set, if necessary
+        if (color == 0) continue;    // ignore empty splits
+        color_table[color][pos] += counts[id];
+    }
+    return;
+  #endif
+
+    // The color sets in the tables are known from an index (and the changes since loading), no need to iterate the tables
+    if (track_colors) {
+        for (auto& deltas : color_deltas) {
+            for (auto it = deltas.begin(); it != deltas.end(); ++it) {
+                kmer_colors[it->first] += it->second;
+            }
+            deltas.clear();
+        }
+        for (auto it = kmer_colors.begin(); it != kmer_colors.end(); ++it) {
+            if (it->second == 0) continue;    // all k-mers of this color set have been extended
+            color_t color = it->first;
+            bool pos = color::represent(color);    // invert the color set, if necessary
+            if (color == 0) continue;    // ignore empty splits
+            color_table[color][pos] += it->second;
+        }
+        return;
+    }
+
+    // The tables have been accumulated group by group, see add_partitions
+    if (max_memory > 0) {
+        return;
+    }
+    add_table_weights(verbose);
+}
+
+/**
+ * This function iterates over the hash tables and adds the split weights to the color table (see add_weights).
+ * @param verbose print progress
+ */
+void graph::add_table_weights(bool& verbose) {
+    uint64_t prog=0, next;
 
     // check table (Amino or base)
     uint64_t max = 0; // table size
-    if (isAmino){for (auto table: kmer_tableAmino){max += table.size();}} // use the sum of amino table sizes
-    else {for (auto table: kmer_table){max+=table.size();}} // use the sum of base table sizes
+    if (isAmino){for (auto& table: kmer_tableAmino){max += table.size();}} // use the sum of amino table sizes
+    else {for (auto& table: kmer_table){max+=table.size();}} // use the sum of base table sizes
 
     // If the tables are empty, there is nothing to be done	    
     if (max==0){
         return;
     }
-    // The iterators for the tables
-    hash_map<kmer_t, color_t>::iterator base_it;
-    hash_map<kmerAmino_t, color_t>::iterator amino_it;
 
-    // Iterate the tables
-    for (int i = 0; i < graph::table_count; i++) // Iterate all tables
-    {
-        if (!isAmino){base_it = kmer_table[i].begin();} // base table iterator
-        else {amino_it = kmer_tableAmino[i].begin();} // amino table iterator
+    // Each thread accumulates the weights of a contiguous range of tables in its own color table
+    uint64_t threads = thread_count > 0 ? thread_count : 1;
+    vector<hash_map<color_t, array<uint32_t,2>>> shards(threads);
+    atomic<uint64_t> cur(0); // number of processed k-mers (for the progress)
 
-        while (true) { // process splits
-            // show progress
-            if (verbose) { 
-                next = 100*cur/max;
-                if (prog < next)  cout << "\33[2K\r" << "Accumulating splits from non-singleton k-mers... " << next << "%" << flush;
-                prog = next; cur++;
+    auto lambda = [&] (uint64_t T) {
+        hash_map<color_t, array<uint32_t,2>>& shard = shards[T];
+        // The iterators for the tables
+        hash_map<kmer_key_t, kmer_color_t>::iterator base_it;
+        hash_map<kmerAmino_t, kmer_color_t>::iterator amino_it;
+
+        // Iterate the tables
+        for (uint64_t i = T*table_count/threads; i < (T+1)*table_count/threads; i++) // Iterate the tables of this thread
+        {
+            if (!isAmino){base_it = kmer_table[i].begin();} // base table iterator
+            else {amino_it = kmer_tableAmino[i].begin();} // amino table iterator
+
+            while (true) { // process splits
+                // update the iterator
+                kmer_color_t* color_ref; // reference of the current color
+                if (isAmino) { // if the amino table is used, update the amino iterator
+                    
+                    if (amino_it == kmer_tableAmino[i].end()){break;} // stop iterating if done
+                    else{color_ref = &amino_it.value(); ++amino_it;} // iterate the amino table
+                    }
+                else { // if the base tables is used update the base iterator
+                    if (base_it == kmer_table[i].end()){break;} // stop itearating if done
+                    else {color_ref = &base_it.value(); ++base_it;} // iterate the base table
+                    }
+              #if defined(useUnified)
+                uint16_t single;
+                if (is_singleton(*color_ref, single)) continue;    // counted by the singleton counters
+              #endif
+                // process
+                color_t color = color_of(*color_ref);
+                bool pos = color::represent(color);    // invert the color set, if necessary
+                if (color == 0) continue;    // ignore empty splits
+                array<uint32_t,2>& weight = shard[color];    // get the weight and inverse weight for the color set
+                weight[pos]++; // update the weight or the inverse weight of the current color set
             }
-            // update the iterator
-            color_t* color_ref; // reference of the current color
-            if (isAmino) { // if the amino table is used, update the amino iterator
-                
-                if (amino_it == kmer_tableAmino[i].end()){break;} // stop iterating if done
-                else{color_ref = &amino_it.value(); ++amino_it;} // iterate the amino table
-                }
-            else { // if the base tables is used update the base iterator
-                // Todo: Get the target hash map index from the kmer bits
-                if (base_it == kmer_table[i].end()){break;} // stop itearating if done
-                else {color_ref = &base_it.value(); ++base_it;} // iterate the base table
+            // show progress
+            if (verbose) {
+                cur += isAmino ? kmer_tableAmino[i].size() : kmer_table[i].size();
+                if (T == 0) { // only the first thread prints
+                    next = 100*cur/max;
+                    if (prog < next)  cout << "\33[2K\r" << "Accumulating splits from non-singleton k-mers... " << next << "%" << flush;
+                    prog = next;
                 }
-            // process
-            color_t& color = *color_ref;
-            bool pos = color::represent(color);    // invert the color set, if necessary
-            if (color == 0) continue;    // ignore empty splits
-            // add_weight(color, mean, min_value, pos);
-			array<uint32_t,2>& weight = color_table[color];    // get the weight and inverse weight for the color set
-			weight[pos]++; // update the weight or the inverse weight of the current color set
-		}
+            }
+        }
+    };
+
+    vector<thread> thread_holder(threads);
+    for (uint64_t thread_id = 0; thread_id < threads; ++thread_id){thread_holder[thread_id] = thread(lambda, thread_id);}
+    for (uint64_t thread_id = 0; thread_id < threads; ++thread_id){thread_holder[thread_id].join();}
+
+    // Merge the color tables of all threads
+    for (auto& shard : shards) {
+        if (color_table.empty()) {
+            color_table = std::move(shard);
+            continue;
+        }
+        for (auto it = shard.begin(); it != shard.end(); ++it) {
+            array<uint32_t,2>& weight = color_table[it->first];
+            weight[0] += it->second[0];
+            weight[1] += it->second[1];
+        }
+        shard = hash_map<color_t, array<uint32_t,2>>(); // free the memory
     }
 }
 
@@ -1395,9 +2067,11 @@ void graph::add_weights(double mean(uint32_t&, uint32_t&), double min_value, boo
  */
 void graph::add_singleton_weights(double mean(uint32_t&, uint32_t&), double min_value, bool& verbose) {
 	
+  #if !defined(useUnified)
 	// not needed anymore
 	singleton_kmer_table.clear();
 	singleton_kmer_tableAmino.clear();	
+  #endif
 	
     //double min_value = numeric_limits<double>::min(); // current min. weight in the top list (>0)
     uint64_t cur=0, prog=0, next;
@@ -1416,25 +2090,37 @@ void graph::add_singleton_weights(double mean(uint32_t&, uint32_t&), double min_
     // Iterate the counters
     for (int i = 0; i < maxN; i++) // Iterate all tables
     {
+            uint64_t count = singleton_count(i); // reduce the counters of all threads
             // show progress
             if (verbose) { 
                 next = 100*cur/max;
                 if (prog < next)  cout << "\33[2K\r" << "Accumulating splits from singleton k-mers... " << next << "%" << flush;
-                prog = next; cur+=singleton_counters[i];
+                prog = next; cur+=count;
             }
-            if (singleton_counters[i]==0) continue;
-// 			cerr << i << ": " << singleton_counters[i] << " " << endl << flush;
+            if (count==0) continue;
+// 			cerr << i << ": " << count << " " << endl << flush;
 			color = 0b0u;
 			color.set(i);
             // process
             // add_weight(color, mean, min_value, pos);
 			array<uint32_t,2>& weight = color_table[color];    // get the weight and inverse weight for the color set
-			weight[0]+=singleton_counters[i]; // update the weight or the inverse weight of the current color set
+			weight[0]+=count; // update the weight or the inverse weight of the current color set
     }
 }
 
 
 
+/**
+ * This function rescales the k-mer counts of a split from a scaled sketch to all k-mers.
+ *
+ * @param counts k-mer counts of a split and its inverse
+ */
+void graph::scale_counts(array<uint32_t,2>& counts) {
+	for (auto& count : counts) {
+		count = min<uint64_t>((uint64_t) count * weight_scale, UINT32_MAX);
+	}
+}
+
 /**
  * This function calculates the weight for all splits and puts them into the split_ölist
  * @param mean weight function
@@ -1442,29 +2128,32 @@ void graph::add_singleton_weights(double mean(uint32_t&, uint32_t&), double min_
  */
 void graph::compile_split_list(double mean(uint32_t&, uint32_t&), double min_value)
 {
+	top_list<double, color_t> top(t);    // select the top t splits first, then order them
+	for (auto& split : split_list) {
+		top.emplace(split.first, split.second);
+	}
+
 	// Iterating over the map using Iterator till map end.
 	hash_map<color_t, array<uint32_t,2>>::iterator it = color_table.begin();
 	while (it != color_table.end())	{
 
 		// Accessing the key
-		color_t colors = it->first;
+		const color_t& colors = it->first;
 		
 		// Accessing the value
 		array<uint32_t,2> weights = it->second;
+		if (weight_scale > 1) {scale_counts(weights);}    // estimate the counts of all k-mers from the sketch
 		
 		//insert into split list
 		double new_mean = mean(weights[0], weights[1]);    // calculate the mean value
 		if (new_mean >= min_value) {    // if it is greater than the min. value, add it to the top list
-			split_list.emplace(new_mean, colors);    // insert it at the correct position ordered by weight
-			if (split_list.size() > t) {
-				split_list.erase(--split_list.end());    // if the top list exceeds its limit, erase the last entry
-				min_value = split_list.rbegin()->first;    // update the min. value for the next iteration (only necessary of t is exceeded, otherwise min_value does not play a role.
-			}
+			top.emplace(new_mean, colors);
 		}
 		
 		// iterator incremented to point next item
 		it++;
 	}
+	split_list = top.to_multimap();
 }
 
 /**
@@ -1487,8 +2176,8 @@ void graph::output_core(ostream& file, bool& verbose)
         return;
     }
     // The iterators for the tables
-    hash_map<kmer_t, color_t>::iterator base_it;
-    hash_map<kmerAmino_t, color_t>::iterator amino_it;
+    hash_map<kmer_key_t, kmer_color_t>::iterator base_it;
+    hash_map<kmerAmino_t, kmer_color_t>::iterator amino_it;
 
     // Iterate the tables
     for (int i = 0; i < graph::table_count; i++) // Iterate all tables
@@ -1504,7 +2193,7 @@ void graph::output_core(ostream& file, bool& verbose)
                 prog = next; cur++;
             }
             // update the iterator
-            color_t* color_ref; // reference of the current color
+            kmer_color_t* color_ref; // reference of the current color
             kmer_t kmer;
 			kmerAmino_t kmerAmino;
             if (isAmino) { // if the amino table is used, update the amino iterator
@@ -1514,10 +2203,14 @@ void graph::output_core(ostream& file, bool& verbose)
             else { // if the base tables is used update the base iterator
                 // Todo: Get the target hash map index from the kmer bits
                 if (base_it == kmer_table[i].end()){break;} // stop itearating if done
-                else {kmer = base_it.key(); color_ref = &base_it.value(); ++base_it;} // iterate the base table
+                else {kmer = restore_kmer(i, base_it.key()); color_ref = &base_it.value(); ++base_it;} // iterate the base table
             }
+          #if defined(useUnified)
+            uint16_t single;
+            if (is_singleton(*color_ref, single)) continue;    // not in the k-mer tables without -DuseUnified
+          #endif
             // process
-            color_t& color = *color_ref;
+            const color_t& color = color_of(*color_ref);
 			all_count++;
 			// is core?
 			if(color::is_complete(color)){
@@ -1543,78 +2236,901 @@ void graph::output_core(ostream& file, bool& verbose)
  * @return number of k-mers in all tables.
  */
 uint64_t graph::number_kmers(){
-	uint64_t num=0;
+	uint64_t num=loaded_kmers;
 	if (isAmino){ // use the sum of amino table sizes
-		for (auto table: kmer_tableAmino){num += table.size();}
+		for (auto& table: kmer_tableAmino){num += table.size();}
 	} else { // use the sum of base table sizeskmer_table.size(); 
-		for (auto table: kmer_table){num+=table.size();}
+		for (auto& table: kmer_table){num+=table.size();}
 	}
+  #if defined(useUnified)
+	for (uint64_t g=0;g<maxN;g++){num -= singleton_count(g);}    // the singleton k-mers in the tables
+  #endif
 	return num;
 }
 
 
+#if defined(useClasses)
+/**
+ * Get the number of k-mers per color class, summed up over the changes recorded by all threads.
+ * @return number of k-mers by color class
+ */
+vector<uint64_t> graph::class_counts(){
+	vector<uint64_t> counts(class_colors.size());
+	for (auto& deltas : class_deltas) {
+		for (uint64_t id = 0; id < deltas.size(); ++id) {counts[id] += deltas[id];}
+	}
+	return counts;
+}
+
+/**
+ * Get the number of color classes, i.e., of distinct color sets (incl. the empty one).
+ * @return number of color classes
+ */
+uint64_t graph::number_classes(){
+	return class_colors.size();
+}
+#endif
+
+#if defined(useHybrid)
+/**
+ * Get the number of k-mers with their color set stored as a list or as a bitset (-DuseHybrid).
+ * @param lists number of k-mers with a list of colors
+ * @param bitsets number of k-mers with a bitset
+ */
+void graph::count_representations(uint64_t& lists, uint64_t& bitsets){
+	lists = 0; bitsets = 0;
+	auto count = [&] (auto& tables) {
+		for (auto& table : tables) {
+			for (auto it = table.begin(); it != table.end(); ++it) {
+			  #if defined(useUnified)
+				uint16_t single;
+				if (is_singleton(it->second, single)) continue;    // only the non-singleton k-mers
+			  #endif
+				it->second.is_dense() ? ++bitsets : ++lists;
+			}
+		}
+	};
+	isAmino ? count(kmer_tableAmino) : count(kmer_table);
+}
+#endif
+
 /**
  * Get the number of singleton k-mers in all tables.
  * @return number of k-mers in all singleton kmer tables.
  */
 uint64_t graph::number_singleton_kmers(){
-	uint64_t num=0;
-	for (uint16_t g=0;g<maxN-1;g++){num += singleton_counters[g];}
+	uint64_t num=loaded_singleton_kmers;
+	for (uint16_t g=0;g<maxN-1;g++){num += singleton_count(g);}
 	return num;
 }
 
+/**
+ * This function counts the keys of a table beyond the first one per home bucket (the first bucket probed),
+ * i.e., the keys that collide with another key and have to be probed further.
+ * For the flat tables (-DuseFlat), these are the keys outside of their home group of 16 slots.
+ * @param table hash table with power-of-two buckets
+ * @param keys number of keys, is increased
+ * @param collisions number of colliding keys, is increased
+ */
+template <typename K, typename V>
+static void count_collisions(const hash_map<K, V>& table, uint64_t& keys, uint64_t& collisions) {
+    if (table.empty()) return;
+    keys += table.size();
+  #if defined(useFlat)
+    for (auto& entry : table) collisions += table.probes(entry.first) > 1;
+  #else
+    vector<uint64_t> home; home.reserve(table.size());
+    for (auto& entry : table) home.push_back(hash<K>()(entry.first) & (table.bucket_count() - 1));
+    sort(home.begin(), home.end());
+    collisions += home.size() - (unique(home.begin(), home.end()) - home.begin());
+  #endif
+}
+
+/**
+ * Get the quality of the k-mer hash: the balance of the bins, and the fraction of colliding k-mers.
+ * @param balance size of the largest bin relative to the mean bin size
+ * @return fraction of k-mers beyond the first one per home bucket (the first bucket probed) of a table
+ */
+double graph::kmer_collisions(double& balance) {
+    uint64_t keys = 0, collisions = 0, largest = 0;
+    for (uint64_t i = 0; i < table_count; ++i) {
+        uint64_t before = keys;
+        if (isAmino) {
+            count_collisions(kmer_tableAmino[i], keys, collisions);
+          #if !defined(useUnified)
+            count_collisions(singleton_kmer_tableAmino[i], keys, collisions);
+          #endif
+        } else {
+            count_collisions(kmer_table[i], keys, collisions);
+          #if !defined(useUnified)
+            count_collisions(singleton_kmer_table[i], keys, collisions);
+          #endif
+        }
+        largest = max(largest, keys - before);
+    }
+    balance = keys > 0 ? (double) largest * table_count / keys : 0;
+    return keys > 0 ? (double) collisions / keys : 0;
+}
+
+/**
+ * Get the quality of the color hash, i.e., the fraction of colliding colors in the color table.
+ * @return fraction of colors beyond the first one per home bucket (the first bucket probed)
+ */
+double graph::color_collisions() {
+    uint64_t keys = 0, collisions = 0;
+    count_collisions(color_table, keys, collisions);
+    return keys > 0 ? (double) collisions / keys : 0;
+}
+
+/**
+ * Get the number of singleton k-mers of a genome, summed up over the counters of all threads.
+ * @param color the genome
+ * @return number of singleton k-mers of this genome
+ */
+uint64_t graph::singleton_count(const uint16_t& color){
+	int64_t num=0;
+	for (auto& counter : singleton_counters){num += counter.count[color];}
+	return num;
+}
+
+
+/*
+*
+* [Index files]
+*
+*/
+
+/**
+ * This is the header of an index file. It is followed by the genomes, the k-mer tables, the singleton tables,
+ * the singleton counters, and the number of k-mers per color set.
+ */
+struct index_header {
+    char magic[8];    // "SANSidx"
+    uint32_t version;    // format version
+    uint32_t max_k;    // compile parameter -DmaxK
+    uint32_t max_n;    // compile parameter -DmaxN
+    uint32_t kmer_bytes;    // size of a stored k-mer
+    uint32_t color_bytes;    // size of a stored color set
+    uint32_t amino;    // amino acid k-mers
+    uint32_t reverse;    // k-mers merged with their reverse complements
+    uint32_t sampling;    // sampling scheme of the window
+    uint64_t k;    // k-mer length
+    uint64_t window;    // number of k-mers per minimizer window
+    uint64_t scaled;    // fraction 1/scaled of k-mers kept
+    uint64_t num;    // number of genomes
+    uint64_t table_count;    // number of hash tables (bins)
+    uint64_t tables_offset;    // position of the tables in the file
+};
+
+/**
+ * This is the header of a split counts file. It is followed by the genomes and the color table, sorted by color.
+ */
+struct counts_header {
+    char magic[8];    // "SANScnt"
+    uint32_t version;    // format version
+    uint32_t max_n;    // compile parameter -DmaxN
+    uint32_t color_bytes;    // size of a stored color set
+    uint32_t amino;    // amino acid k-mers
+    uint32_t reverse;    // k-mers merged with their reverse complements
+    uint32_t sampling;    // sampling scheme of the window
+    uint64_t k;    // k-mer length
+    uint64_t window;    // number of k-mers per minimizer window
+    uint64_t scaled;    // fraction 1/scaled of k-mers kept
+    uint64_t num;    // number of genomes
+    uint64_t kmers;    // number of non-singleton k-mers
+    uint64_t singleton_kmers;    // number of singleton k-mers
+    uint64_t size;    // number of colors
+    uint64_t table_offset;    // position of the color table in the file
+};
+
+static const char index_magic[8] = "SANSidx";
+static const char counts_magic[8] = "SANScnt";
+static const uint32_t index_version = 4;    // the bins of the tables depend on the k-mer hash
+
+/**
+ * This is a read-only file, mapped into memory if possible (otherwise read into a buffer).
+ */
+struct mapped_file {
+    const char* data = nullptr;
+    size_t size = 0;
+    vector<char> buffer;
+
+    explicit mapped_file(const string& file_name) {
+#if !defined(_WIN32)
+        int fd = open(file_name.c_str(), O_RDONLY);
+        struct stat info;
+        if (fd >= 0 && fstat(fd, &info) == 0 && info.st_size > 0) {
+            void* map = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map != MAP_FAILED) {
+                data = static_cast<const char*>(map);
+                size = info.st_size;
+                madvise(map, size, MADV_SEQUENTIAL);    // the file is read once from front to back
+            }
+        }
+        if (fd >= 0) close(fd);
+#endif
+        if (data == nullptr) {
+            ifstream in(file_name, ios::binary);
+            buffer.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+            data = buffer.data();
+            size = buffer.size();
+        }
+    }
+
+    ~mapped_file() {
+#if !defined(_WIN32)
+        if (buffer.empty() && data != nullptr) munmap((void*) data, size);
+#endif
+    }
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+};
+
+/**
+ * This function writes the binary representation of a value.
+ * @param out output stream
+ * @param value value to write
+ */
+template <typename T>
+static void write_value(ostream& out, const T& value) {
+    static_assert(is_standard_layout<T>::value, "binary values have to be plain storage");    // k-mers and colors only wrap their bits
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+/**
+ * This function writes a string with its length.
+ * @param out output stream
+ * @param str string to write
+ */
+static void write_string(ostream& out, const string& str) {
+    write_value<uint64_t>(out, str.size());
+    out.write(str.data(), str.size());
+}
+
+/**
+ * This function reads the binary representation of a value, if within the given range.
+ * @param pos current position, moved behind the value
+ * @param end end of the readable range
+ * @param value value read
+ * @return false, if the range is exceeded
+ */
+template <typename T>
+static bool read_value(const char*& pos, const char* end, T& value) {
+    if (end - pos < (ptrdiff_t) sizeof(T)) return false;
+    memcpy(&value, pos, sizeof(T));
+    pos += sizeof(T);
+    return true;
+}
+
+/**
+ * This function reads a string with its length, if within the given range.
+ * @param pos current position, moved behind the string
+ * @param end end of the readable range
+ * @param str string read
+ * @return false, if the range is exceeded
+ */
+static bool read_string(const char*& pos, const char* end, string& str) {
+    uint64_t size;
+    if (!read_value(pos, end, size) || (uint64_t) (end - pos) < size) return false;
+    str.assign(pos, size);
+    pos += size;
+    return true;
+}
+
+/**
+ * This function writes the name and the files of each genome.
+ * @param out output stream
+ * @param info parameters and genomes
+ */
+static void write_genomes(ostream& out, const index_info& info) {
+    for (uint64_t g = 0; g < info.names.size(); ++g) {
+        write_string(out, info.names[g]);
+        const vector<string>& files = g < info.files.size() ? info.files[g] : vector<string>();
+        write_value<uint64_t>(out, files.size());
+        for (auto& file : files) write_string(out, file);
+    }
+}
+
+/**
+ * This function reads the name and the files of each genome, if within the given range.
+ * @param pos current position, moved behind the genomes
+ * @param end end of the readable range
+ * @param num number of genomes
+ * @param info parameters and genomes
+ * @return false, if the range is exceeded
+ */
+static bool read_genomes(const char*& pos, const char* end, const uint64_t& num, index_info& info) {
+    info.names.resize(num);
+    info.files.resize(num);
+    for (uint64_t g = 0; g < num; ++g) {
+        uint64_t files;
+        if (!read_string(pos, end, info.names[g]) || !read_value(pos, end, files)) return false;
+        if ((uint64_t) (end - pos) / sizeof(uint64_t) < files) return false;
+        info.files[g].resize(files);
+        for (auto& file : info.files[g]) {
+            if (!read_string(pos, end, file)) return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * These functions convert a value of the hash tables to its binary representation and back,
+ * i.e., a color class (-DuseClasses) is stored as its color set.
+ * @param value value of a hash table
+ * @return the value stored in an index
+ */
+template <typename V>
+static const V& stored_value(const V& value) {return value;}
+template <typename V>
+static void restore_value(const V& stored, V& value) {value = stored;}
+#if defined(useClasses)
+static const color_t& stored_value(const uint32_t& id) {return graph::color_of(id);}
+static void restore_value(const color_t& stored, uint32_t& id) {id = graph::intern_class(stored);}
+#elif defined(useHybrid)
+static color_t stored_value(const hybrid_color_t& value) {return value.colors();}
+static void restore_value(const color_t& stored, hybrid_color_t& value) {value = hybrid_color_t(stored);}
+#endif
+
+/**
+ * These functions convert a key of the hash tables to its binary representation and back,
+ * i.e., a quotient (-DuseQuotient) is stored as its k-mer.
+ * @param bin bin of the hash table
+ * @param key key of a hash table
+ * @return the key stored in an index
+ */
+template <typename K>
+static const K& stored_key(const uint64_t& bin, const K& key) {return key;}
+template <typename K>
+static void restore_key(const K& stored, K& key) {key = stored;}
+#if defined(useQuotient)
+static kmer_t stored_key(const uint64_t& bin, const quotient_t& key) {return graph::restore_kmer(bin, key);}
+static void restore_key(const kmer_t& stored, quotient_t& key) {key = graph::compute_key(stored);}
+#endif
+
+/**
+ * This function writes the hash tables sorted by k-mer, each preceded by its size.
+ * @param out output stream
+ * @param tables k-mer tables (k-mer to color set or genome)
+ */
+template <typename K, typename V>
+static void write_tables(ostream& out, vector<hash_map<K, V>>& tables) {
+    using S = decay_t<decltype(stored_key(0, declval<K>()))>;
+    vector<pair<S, V>> entries;
+    for (uint64_t bin = 0; bin < tables.size(); ++bin) {
+        entries.clear();
+        for (auto it = tables[bin].begin(); it != tables[bin].end(); ++it) entries.emplace_back(stored_key(bin, it->first), it->second);
+        sort(entries.begin(), entries.end(), [] (const pair<S, V>& x, const pair<S, V>& y) {return x.first < y.first;});
+        write_value<uint64_t>(out, entries.size());
+        for (auto& entry : entries) {
+            write_value(out, entry.first);
+            write_value(out, stored_value(entry.second));
+        }
+    }
+}
+
+/**
+ * This function fills the hash tables from their binary representation.
+ * @param pos current position, moved behind the tables
+ * @param end end of the readable range
+ * @param tables k-mer tables (k-mer to color set or genome)
+ * @return false, if the range is exceeded
+ */
+template <typename K, typename V>
+static bool read_tables(const char*& pos, const char* end, vector<hash_map<K, V>>& tables) {
+    K key; V value;
+    decay_t<decltype(stored_key(0, key))> kmer;
+    decay_t<decltype(stored_value(value))> stored;
+    for (auto& table : tables) {
+        uint64_t size;
+        if (!read_value(pos, end, size)) return false;
+        if ((uint64_t) (end - pos) / (sizeof(kmer) + sizeof(stored)) < size) return false;
+        table.reserve(table.size() + size);
+        for (uint64_t i = 0; i < size; ++i) {
+            read_value(pos, end, kmer);
+            read_value(pos, end, stored);
+            restore_key(kmer, key);
+            restore_value(stored, value);
+            table.insert({key, value});
+        }
+    }
+    return true;
+}
+
+#if defined(useUnified)
+/**
+ * This function writes the unified hash tables (-DuseUnified) as without them, i.e., either the non-singleton k-mers
+ * as k-mer tables, or the singleton k-mers as singleton tables, each sorted by k-mer and preceded by its size.
+ * @param out output stream
+ * @param tables k-mer tables (k-mer to color set or singleton)
+ * @param singletons write the singleton tables (k-mer to genome)
+ */
+template <typename K>
+static void write_tables(ostream& out, vector<hash_map<K, kmer_color_t>>& tables, const bool& singletons) {
+    using S = decay_t<decltype(stored_key(0, declval<K>()))>;
+    vector<pair<S, kmer_color_t>> entries;
+    uint16_t color;
+    for (uint64_t bin = 0; bin < tables.size(); ++bin) {
+        entries.clear();
+        for (auto it = tables[bin].begin(); it != tables[bin].end(); ++it) {
+            if (graph::is_singleton(it->second, color) == singletons) entries.emplace_back(stored_key(bin, it->first), it->second);
+        }
+        sort(entries.begin(), entries.end(), [] (const pair<S, kmer_color_t>& x, const pair<S, kmer_color_t>& y) {return x.first < y.first;});
+        write_value<uint64_t>(out, entries.size());
+        for (auto& entry : entries) {
+            write_value(out, entry.first);
+            if (singletons) {graph::is_singleton(entry.second, color); write_value(out, color);}
+            else {write_value(out, stored_value(entry.second));}
+        }
+    }
+}
+
+/**
+ * This function fills the unified hash tables (-DuseUnified) from the binary representation of singleton tables.
+ * @param pos current position, moved behind the tables
+ * @param end end of the readable range
+ * @param tables k-mer tables (k-mer to color set or singleton)
+ * @return false, if the range is exceeded
+ */
+template <typename K>
+static bool read_singleton_tables(const char*& pos, const char* end, vector<hash_map<K, kmer_color_t>>& tables) {
+    K key; uint16_t color;
+    decay_t<decltype(stored_key(0, key))> kmer;
+    for (auto& table : tables) {
+        uint64_t size;
+        if (!read_value(pos, end, size)) return false;
+        if ((uint64_t) (end - pos) / (sizeof(K) + sizeof(color)) < size) return false;
+        table.reserve(table.size() + size);
+        for (uint64_t i = 0; i < size; ++i) {
+            read_value(pos, end, kmer);
+            read_value(pos, end, color);
+            restore_key(kmer, key);
+            table.insert({key, graph::singleton_value(color)});
+        }
+    }
+    return true;
+}
+#endif
+
+/**
+ * This function writes the k-mer tables, the singleton tables and counters, and the genomes to a binary file.
+ * (To call befor add_weights)
+ * @param file_name index file
+ * @param info parameters and genomes of the index
+ * @return false, if the file could not be written
+ */
+bool graph::save_index(const string& file_name, const index_info& info) {
+    ofstream out(file_name, ios::binary);
+    if (!out.good()) return false;
+
+    index_header header = {};
+    memcpy(header.magic, index_magic, sizeof(index_magic));
+    header.version = index_version;
+    header.max_k = maxK;
+    header.max_n = maxN;
+    header.kmer_bytes = isAmino ? sizeof(kmerAmino_t) : sizeof(kmer_t);
+    header.color_bytes = sizeof(color_t);
+    header.amino = isAmino;
+    header.reverse = info.reverse;
+    header.k = info.k;
+    header.window = info.window;
+    header.sampling = info.sampling;
+    header.scaled = info.scaled;
+    header.num = info.names.size();
+    header.table_count = table_count;
+    write_value(out, header);    // rewritten with the offset of the tables below
+    write_genomes(out, info);
+
+    // the tables and the singleton counters
+    header.tables_offset = out.tellp();
+  #if defined(useUnified)
+    if (isAmino) {
+        write_tables(out, kmer_tableAmino, false);
+        write_tables(out, kmer_tableAmino, true);
+    } else {
+        write_tables(out, kmer_table, false);
+        write_tables(out, kmer_table, true);
+    }
+  #else
+    if (isAmino) {
+        write_tables(out, kmer_tableAmino);
+        write_tables(out, singleton_kmer_tableAmino);
+    } else {
+        write_tables(out, kmer_table);
+        write_tables(out, singleton_kmer_table);
+    }
+  #endif
+    for (uint64_t g = 0; g < header.num; ++g) {
+        write_value<uint64_t>(out, singleton_count(g));
+    }
+
+    // the number of k-mers per color set, sorted by color
+    hash_map<color_t, uint64_t> colors;
+    auto count = [&] (auto& tables) {
+        for (auto& table : tables) {
+            for (auto it = table.begin(); it != table.end(); ++it) {
+              #if defined(useUnified)
+                uint16_t single;
+                if (is_singleton(it->second, single)) continue;    // only the non-singleton k-mers
+              #endif
+                colors[color_of(it->second)]++;
+            }
+        }
+    };
+    isAmino ? count(kmer_tableAmino) : count(kmer_table);
+    vector<pair<color_t, uint64_t>> entries(colors.begin(), colors.end());
+    sort(entries.begin(), entries.end(), [] (const pair<color_t, uint64_t>& x, const pair<color_t, uint64_t>& y) {return x.first < y.first;});
+    write_value<uint64_t>(out, entries.size());
+    for (auto& entry : entries) {
+        write_value(out, entry.first);
+        write_value(out, entry.second);
+    }
+
+    out.seekp(0);
+    write_value(out, header);
+    return out.good();
+}
+
+/**
+ * This function reads the parameters and genomes of an index file (To call before init).
+ * @param file_name index file
+ * @param info parameters and genomes of the index
+ * @return false, if the file is not a valid index for this build (maxK, maxN)
+ */
+bool graph::read_index_info(const string& file_name, index_info& info) {
+    mapped_file file(file_name);
+    const char* pos = file.data;
+    const char* end = file.data + file.size;
+    index_header header;
+    if (!read_value(pos, end, header) || memcmp(header.magic, index_magic, sizeof(index_magic)) != 0 || header.version != index_version) {
+        cerr << "Error: not a SANS index (version " << index_version << "): " << file_name << endl;
+        return false;
+    }
+    if (header.max_k != maxK || header.max_n != maxN || header.color_bytes != sizeof(color_t)
+        || header.kmer_bytes != (header.amino ? sizeof(kmerAmino_t) : sizeof(kmer_t))) {
+        cerr << "Error: index was built with -DmaxK=" << header.max_k << " -DmaxN=" << header.max_n;
+        cerr << ", but this build uses -DmaxK=" << maxK << " -DmaxN=" << maxN << endl;
+        return false;
+    }
 
+    info.k = header.k;
+    info.window = header.window;
+    info.sampling = (sampling_scheme) header.sampling;
+    info.scaled = header.scaled;
+    info.amino = header.amino;
+    info.reverse = header.reverse;
+    return read_genomes(pos, end, header.num, info);
+}
 
+/**
+ * This function fills the k-mer tables, the singleton tables and counters from an index file (To call after init).
+ * The file is mapped into memory, if possible. From now on, the changes of the color sets are tracked,
+ * so that the color table can be computed from the color counts of the index and these changes.
+ * @param file_name index file
+ * @return false, if the file is not a valid index for this build
+ */
+bool graph::load_index(const string& file_name) {
+    mapped_file file(file_name);
+    const char* pos = file.data;
+    const char* end = file.data + file.size;
+    index_header header;
+    bool valid = read_value(pos, end, header) && memcmp(header.magic, index_magic, sizeof(index_magic)) == 0
+              && header.version == index_version && header.table_count == table_count && (bool) header.amino == isAmino
+              && header.tables_offset <= file.size;
+    if (valid) {
+        pos = file.data + header.tables_offset;
+      #if defined(useUnified)
+        valid = isAmino ? read_tables(pos, end, kmer_tableAmino) && read_singleton_tables(pos, end, kmer_tableAmino)
+                        : read_tables(pos, end, kmer_table) && read_singleton_tables(pos, end, kmer_table);
+      #else
+        valid = isAmino ? read_tables(pos, end, kmer_tableAmino) && read_tables(pos, end, singleton_kmer_tableAmino)
+                        : read_tables(pos, end, kmer_table) && read_tables(pos, end, singleton_kmer_table);
+      #endif
+        for (uint64_t g = 0; valid && g < header.num; ++g) {
+            uint64_t count;
+            valid = read_value(pos, end, count);
+            singleton_counters[0].count[g] += count;
+        }
+        uint64_t size;
+        valid = valid && read_value(pos, end, size) && (uint64_t) (end - pos) / (sizeof(color_t) + sizeof(uint64_t)) >= size;
+        if (valid) {
+          #if !defined(useClasses)
+            kmer_colors.reserve(size);
+          #endif
+            color_t color;
+            uint64_t count;
+            for (uint64_t i = 0; i < size; ++i) {
+                read_value(pos, end, color);
+                read_value(pos, end, count);
+              #if defined(useClasses)
+                class_delta(class_deltas[0], intern_class(color)) += count;    // the classes are counted anyway
+              #else
+                kmer_colors[color] += count;
+              #endif
+            }
+            track_colors = true;    // the color table can be computed from these counts
+        }
+    }
+    return valid;
+}
 
 /**
- * This function generates a bootstrap replicate. We mimic drawing n k-mers at random with replacement from all n observed k-mers. Say a k-mer would be drawn x times. Instead, we calculate x for each k-mer (in each split in color_table) from a binomial distribution (n repetitions, 1/n success rate) and calculate a new split weight according to the new number of k-mers.
+ * This function lets the k-mers be written to partitions on disk instead of the tables (--max-memory, to call after init),
+ * so that only a group of partitions has to fit into memory at a time (see add_partitions).
+ * @param memory the memory budget of the tables in bytes
+ * @param folder folder of the temporary partition files
+ * @return false, if the partition files could not be created
+ */
+bool graph::init_partitions(const uint64_t& memory, const string& folder) {
+    uint64_t count = 0b1u << partition_bits;
+    max_memory = memory;
+    partition_files = vector<FILE*> (count, nullptr);
+    partition_records = vector<uint64_t> (count);
+    partition_lock = vector<spinlock> (count);
+    if (isAmino) {partition_buffers_amino = vector<vector<vector<pair<kmerAmino_t, uint16_t>>>> (thread_count, vector<vector<pair<kmerAmino_t, uint16_t>>> (count));}
+    else {partition_buffers = vector<vector<vector<pair<kmer_t, uint16_t>>>> (thread_count, vector<vector<pair<kmer_t, uint16_t>>> (count));}
+
+    string prefix = folder + "/SANS-" + to_string(chrono::steady_clock::now().time_since_epoch().count()) + "-";
+    for (uint64_t p = 0; p < count; ++p) {
+        string file_name = prefix + to_string(p) + ".tmp";
+        partition_files[p] = fopen(file_name.c_str(), "w+b");
+        if (partition_files[p] == nullptr) {
+            cerr << "Error: could not create temporary file: " << file_name << endl;
+            return false;
+        }
+      #if !defined(_WIN32)
+        remove(file_name.c_str());    // the file is deleted when closed, also if SANS is aborted
+      #endif
+    }
+    partitioned = true;
+    return true;
+}
+
+/**
+ * This function inserts the partitions into the tables group by group, as many as fit into the memory budget.
+ * Each group is accumulated into the color table, its core k-mers are output, and its tables are freed.
+ * (To call after reading, before add_weights)
+ * @param core output stream of the core k-mers, or nullptr
+ * @param verbose print progress
+ * @return false, if a partition file could not be read
+ */
+bool graph::add_partitions(ostream* core, bool& verbose) {
+    partitioned = false;    // from now on, the k-mers are inserted into the tables
+    uint64_t count = partition_files.size();
+
+    // the records still buffered by the threads
+    for (uint64_t T = 0; T < thread_count; ++T) {
+        for (uint64_t p = 0; p < count; ++p) {
+            if (isAmino && !partition_buffers_amino[T][p].empty()) flush_partition(partition_buffers_amino[T][p], partition_files[p], partition_lock[p], partition_records[p]);
+            if (!isAmino && !partition_buffers[T][p].empty()) flush_partition(partition_buffers[T][p], partition_files[p], partition_lock[p], partition_records[p]);
+        }
+    }
+    partition_buffers = {};
+    partition_buffers_amino = {};
+
+    // the size of a record on disk, and of a k-mer in the tables (about half full)
+    uint64_t record = (isAmino ? sizeof(kmerAmino_t) : sizeof(kmer_t)) + sizeof(uint16_t);
+    uint64_t entry = 2 * (isAmino ? sizeof(pair<kmerAmino_t, kmer_color_t>) : sizeof(pair<kmer_key_t, kmer_color_t>));
+    uint64_t total = 0, done = 0, prog = 0, next;
+    for (auto& records : partition_records) {total += records;}
+    bool quiet = false;
+
+    for (uint64_t first = 0; first < count; ) {
+        // the next group of partitions that fits into the memory budget (at least one partition)
+        uint64_t last = first + 1, records = partition_records[first];
+        while (last < count && (records + partition_records[last]) * entry <= max_memory) {records += partition_records[last++];}
+
+        // insert the partitions of the group, one thread per partition (their bins are disjoint, no locking)
+        atomic<uint64_t> partition(first);
+        atomic<bool> valid(true);
+        auto lambda = [&] (uint64_t T) {
+            vector<char> bytes(partition_buffer * record);
+            kmer_t kmer; kmerAmino_t kmerAmino; uint16_t color;
+            for (uint64_t p = partition++; p < last; p = partition++) {
+                rewind(partition_files[p]);
+                for (uint64_t left = partition_records[p]; left > 0; ) {
+                    uint64_t n = min(left, partition_buffer);
+                    if (fread(bytes.data(), record, n, partition_files[p]) != n) {valid = false; break;}
+                    for (const char* pos = bytes.data(); pos != bytes.data() + n * record; pos += record) {
+                        memcpy(&color, pos + record - sizeof(uint16_t), sizeof(uint16_t));
+                        if (isAmino) {memcpy(&kmerAmino, pos, sizeof(kmerAmino_t)); store_kmer_amino(T, compute_amino_bin(kmerAmino), kmerAmino, color);}
+                        else {memcpy(&kmer, pos, sizeof(kmer_t)); store_kmer(T, compute_bin(kmer), kmer, color);}
+                    }
+                    left -= n;
+                }
+                fclose(partition_files[p]);
+                partition_files[p] = nullptr;
+            }
+        };
+        vector<thread> thread_holder(min(thread_count, last - first));
+        for (uint64_t thread_id = 0; thread_id < thread_holder.size(); ++thread_id){thread_holder[thread_id] = thread(lambda, thread_id);}
+        for (uint64_t thread_id = 0; thread_id < thread_holder.size(); ++thread_id){thread_holder[thread_id].join();}
+        if (!valid) {
+            cerr << "Error: could not read the k-mers from disk (--max-memory)" << endl;
+            return false;
+        }
+
+        // the weights, the core k-mers, and the number of k-mers of the group, then its tables are freed
+      #if !defined(useClasses)
+        add_table_weights(quiet);    // the color classes are counted anyway
+      #endif
+        if (core != nullptr) {output_core(*core, quiet);}
+        for (uint64_t bin = first << (table_bits - partition_bits); bin < last << (table_bits - partition_bits); ++bin) {
+            if (isAmino) {
+                loaded_kmers += kmer_tableAmino[bin].size();
+                kmer_tableAmino[bin] = hash_map<kmerAmino_t, kmer_color_t>();
+              #if !defined(useUnified)
+                singleton_kmer_tableAmino[bin] = hash_map<kmerAmino_t, uint16_t>();
+              #endif
+            } else {
+                loaded_kmers += kmer_table[bin].size();
+                kmer_table[bin] = hash_map<kmer_key_t, kmer_color_t>();
+              #if !defined(useUnified)
+                singleton_kmer_table[bin] = hash_map<kmer_key_t, uint16_t>();
+              #endif
+            }
+        }
+
+        // show progress
+        if (verbose) {
+            done += records;
+            next = total > 0 ? 100*done/total : 100;
+            if (prog < next)  cout << "\33[2K\r" << "Inserting k-mers from disk... " << next << "%" << flush;
+            prog = next;
+        }
+        first = last;
+    }
+    return true;
+}
+
+/**
+ * This function writes the color table, i.e., the counts of all splits, and the genomes to a binary file.
+ * (To call after add_weights and add_singleton_weights)
+ * @param file_name split counts file
+ * @param info parameters and genomes
+ * @return false, if the file could not be written
+ */
+bool graph::save_counts(const string& file_name, const index_info& info) {
+    ofstream out(file_name, ios::binary);
+    if (!out.good()) return false;
+
+    counts_header header = {};
+    memcpy(header.magic, counts_magic, sizeof(counts_magic));
+    header.version = index_version;
+    header.max_n = maxN;
+    header.color_bytes = sizeof(color_t);
+    header.amino = isAmino;
+    header.reverse = info.reverse;
+    header.k = info.k;
+    header.window = info.window;
+    header.sampling = info.sampling;
+    header.scaled = info.scaled;
+    header.num = info.names.size();
+    header.kmers = number_kmers();
+    header.singleton_kmers = number_singleton_kmers();
+    header.size = color_table.size();
+    write_value(out, header);    // rewritten with the offset of the table below
+    write_genomes(out, info);
+
+    // the color table, sorted by color
+    header.table_offset = out.tellp();
+    vector<pair<color_t, array<uint32_t,2>>> entries(color_table.begin(), color_table.end());
+    sort(entries.begin(), entries.end(), [] (const pair<color_t, array<uint32_t,2>>& x, const pair<color_t, array<uint32_t,2>>& y) {return x.first < y.first;});
+    for (auto& entry : entries) {
+        write_value(out, entry.first);
+        write_value(out, entry.second[0]);
+        write_value(out, entry.second[1]);
+    }
+
+    out.seekp(0);
+    write_value(out, header);
+    return out.good();
+}
+
+/**
+ * This function reads the parameters and genomes of a split counts file (To call before init).
+ * @param file_name split counts file
+ * @param info parameters and genomes
+ * @return false, if the file is not a valid split counts file for this build (maxN)
+ */
+bool graph::read_counts_info(const string& file_name, index_info& info) {
+    mapped_file file(file_name);
+    const char* pos = file.data;
+    const char* end = file.data + file.size;
+    counts_header header;
+    if (!read_value(pos, end, header) || memcmp(header.magic, counts_magic, sizeof(counts_magic)) != 0 || header.version != index_version) {
+        cerr << "Error: not a SANS split counts file (version " << index_version << "): " << file_name << endl;
+        return false;
+    }
+    if (header.max_n != maxN || header.color_bytes != sizeof(color_t)) {
+        cerr << "Error: split counts were computed with -DmaxN=" << header.max_n << ", but this build uses -DmaxN=" << maxN << endl;
+        return false;
+    }
+
+    info.k = header.k;
+    info.window = header.window;
+    info.sampling = (sampling_scheme) header.sampling;
+    info.scaled = header.scaled;
+    info.amino = header.amino;
+    info.reverse = header.reverse;
+    return read_genomes(pos, end, header.num, info);
+}
+
+/**
+ * This function fills the color table from a split counts file (To call after init).
+ * @param file_name split counts file
+ * @return false, if the file is not a valid split counts file for this build
+ */
+bool graph::load_counts(const string& file_name) {
+    mapped_file file(file_name);
+    const char* pos = file.data;
+    const char* end = file.data + file.size;
+    counts_header header;
+    bool valid = read_value(pos, end, header) && memcmp(header.magic, counts_magic, sizeof(counts_magic)) == 0
+              && header.version == index_version && header.color_bytes == sizeof(color_t) && header.table_offset <= file.size;
+    if (valid) {
+        pos = file.data + header.table_offset;
+        valid = (uint64_t) (end - pos) / (sizeof(color_t) + 2*sizeof(uint32_t)) >= header.size;
+        color_table.reserve(color_table.size() + header.size);
+        color_t color;
+        uint32_t counts[2];
+        for (uint64_t i = 0; valid && i < header.size; ++i) {
+            read_value(pos, end, color);
+            read_value(pos, end, counts);
+            array<uint32_t,2>& weight = color_table[color];
+            weight[0] += counts[0];
+            weight[1] += counts[1];
+        }
+        loaded_kmers += header.kmers;
+        loaded_singleton_kmers += header.singleton_kmers;
+    }
+    return valid;
+}
+
+
+
+
+/**
+ * This function generates a bootstrap replicate. We mimic drawing n k-mers at random with replacement from all n observed k-mers. Say a k-mer would be drawn x times. The sum of x over the w k-mers of a split follows a binomial distribution (w*n repetitions, 1/n success rate), so we draw the new number of k-mers for each split (in color_table) at once and calculate a new split weight accordingly.
  * @param mean weight function
+ * @param seed the seed of the random numbers
+ * @param replicate the number of the replicate
  * @return the new list of splits of length at least t ordered by weight as usual
  */
-multimap_<double, color_t> graph::bootstrap(double mean(uint32_t&, uint32_t&)) {
+multimap_<double, color_t> graph::bootstrap(double mean(uint32_t&, uint32_t&), const uint64_t& seed, const uint64_t& replicate) {
 
 	uint64_t max = graph::number_kmers();
+	uint64_t stream = counter_rng::mix(counter_rng::mix(seed) + replicate);    // the random stream of this replicate
+	std::hash<color_t> hash;
 
-	std::random_device rd;
-	std::mt19937 gen(rd());
-
-	multimap_<double, color_t> sl;
+	top_list<double, color_t> sl(t);    // select the top t splits first, then order them
 	double min_value=0;
-
-	// perform n time max trials, each succeeds 1/max
-	std::binomial_distribution<> d(max, 1.0/max);
 	
 	// Iterating over the map using Iterator till map end.
 	hash_map<color_t, array<uint32_t,2>>::iterator it = color_table.begin();
 	while (it != color_table.end())	{
 
 		// Accessing the key
-		color_t colors = it->first;
+		const color_t& colors = it->first;
 		
 		// Accessing the value
 		array<uint32_t,2> weights = it->second;
 		
 		// bootstrap the number of kmer occurrences for split and inverse
+		counter_rng gen(counter_rng::mix(stream ^ hash(colors)));    // independent of the iteration order
 		array<uint32_t,2> new_weights;
-		new_weights[0]=0;
-		new_weights[1]=0;
 		for (int i=0;i<2;i++) {
-			for (int r=0;r<weights[i];r++){
-				new_weights[i] += d(gen);
-			}
-// 			uint64_t n = weights[i]*max;
-// 			std::binomial_distribution<> dn(n, 1.0/max);
-// 			cout << weights[i] << "\t" << dn(gen) << "\t" << new_weights[i] << "\n" << flush;
+			// perform weight time max trials, each succeeds 1/max
+			uint64_t n = (uint64_t) weights[i] * max;
+			new_weights[i] = n == 0 ? 0 : std::binomial_distribution<uint64_t>(n, 1.0/max)(gen);
 		}
+		if (weight_scale > 1) {scale_counts(new_weights);}    // estimate the counts of all k-mers from the sketch
 		
 		//insert into new split list
 		double new_mean = mean(new_weights[0], new_weights[1]);    // calculate the new mean value
 		if (new_mean >= min_value) {    // if it is greater than the min. value, add it to the top list
-			sl.emplace(new_mean, colors);    // insert it at the correct position ordered by weight
-			if (sl.size() > t) {
-				sl.erase(--sl.end());    // if the top list exceeds its limit, erase the last entry
-				min_value = sl.rbegin()->first;    // update the min. value for the next iteration (only necessary of t is exceeded, otherwise min_value does not play a role.
-			}
+			sl.emplace(new_mean, colors);
 		}
 		
 		// iterator incremented to point next item
@@ -1622,7 +3138,7 @@ multimap_<double, color_t> graph::bootstrap(double mean(uint32_t&, uint32_t&)) {
 		
 	}
 
-	return sl;
+	return sl.to_multimap();
 }
 
 
@@ -1644,6 +3160,9 @@ void graph::add_split(double& weight, color_t& color) {
  * @param split_list list of splits
  */
 void graph::add_split(double& weight, color_t& color, multimap_<double, color_t>& split_list) {
+    if (split_list.size() >= t && (t == 0 || !compare<double, color_t>()({weight, color}, *split_list.rbegin()))) {
+        return;    // the top list is full and the split would be erased right away
+    }
     split_list.emplace(weight, color);    // insert it at the correct position ordered by weight
     if (split_list.size() > t) {
         split_list.erase(--split_list.end());    // if the top list exceeds its limit, erase the last entry
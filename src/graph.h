@@ -10,6 +10,7 @@
 
 #include <iomanip>
 #include <string>
+#include <string_view>
 #include <random>
 
 
@@ -18,17 +19,29 @@
 #include <set>
 #include <unordered_map>
 #include <unordered_set>
-#include "tsl/sparse_map.h"
-#include "tsl/sparse_set.h"
+#if defined(useFlat)
+    #include "flat_hash.h"
+#else
+    #include "tsl/sparse_map.h"
+    #include "tsl/sparse_set.h"
+#endif
 
 using namespace std;
 
+// power-of-two buckets, i.e., the low bits of the hash (the k-mer and color hashes mix all bits, see byte.h)
+#if defined(useFlat)    // flat open-addressing tables: faster, but more memory
+template <typename K, typename V>
+    using hash_map = flat_map<K,V>;
+template <typename T>
+    using hash_set = flat_set<T>;
+#else    // sparse tables: less memory
 template <typename K, typename V>
     // using hash_map = unordered_map<K,V>;
-    using hash_map = tsl::sparse_pg_map<K,V>;
+    using hash_map = tsl::sparse_map<K,V>;
 template <typename T>
     // using hash_set = unordered_set<T>;
-    using hash_set = tsl::sparse_pg_set<T>;
+    using hash_set = tsl::sparse_set<T>;
+#endif
 
 //stable sorting of split weights
 template <typename K, typename V>
@@ -40,6 +53,44 @@ template <typename K, typename V>
 template <typename K, typename V>
   using multimap_ = set<pair<K,V>, compare<K,V>>;
 
+//selection of the top t entries on a flat vector, ordered as multimap_ only once at the end
+template <typename K, typename V>
+  class top_list {
+    public:
+      explicit top_list(uint64_t t) : t(t) {}
+
+      // add an entry, unless it cannot be among the top t anymore
+      void emplace(const K& key, const V& value) {
+          if (t == 0 || (full && key < bound)) return;
+          entries.emplace_back(key, value);
+          if (entries.size() / 2 >= t) prune();    // keep at most 2t entries
+      }
+
+      // the ordered list of the top t entries
+      multimap_<K,V> to_multimap() {
+          if (entries.size() > t) prune();
+          sort(entries.begin(), entries.end(), compare<K,V>());
+          multimap_<K,V> list;
+          for (auto& entry : entries) list.emplace_hint(list.end(), entry);
+          entries.clear();
+          return list;
+      }
+
+    private:
+      // keep the top t entries, the t-th one bounds all further entries
+      void prune() {
+          nth_element(entries.begin(), entries.begin() + (t-1), entries.end(), compare<K,V>());
+          entries.resize(t);
+          bound = entries.back().first;
+          full = true;
+      }
+
+      uint64_t t;
+      vector<pair<K,V>> entries;
+      K bound{};
+      bool full = false;
+  };
+
 
 
 #include "kmer.h"
@@ -49,6 +100,43 @@ template <typename K, typename V>
 
 #include "color.h"
 
+// the color set of a k-mer in the k-mer tables
+#if defined(useClasses) && defined(useHybrid)
+    #error "-DuseClasses and -DuseHybrid are alternatives"
+#elif defined(useClasses)    // the id of its color class, i.e., of the interned color set (less memory for large maxN)
+    typedef uint32_t kmer_color_t;
+#elif defined(useHybrid)    // a list of few colors, or a bitset (less memory for large maxN)
+    typedef hybrid_color_t kmer_color_t;
+#else    // the color set itself
+    typedef color_t kmer_color_t;
+#endif
+
+// the key of a k-mer in the k-mer tables
+#if defined(useQuotient)    // the low bits of its hash, the high bits select the table (less memory)
+  #if maxK > 32
+    #error "-DuseQuotient needs single-word k-mers, i.e., -DmaxK=32 or less"
+  #endif
+/**
+ * This is the key of a k-mer in its k-mer table (-DuseQuotient): the low 64-table_bits bits of its hash,
+ * i.e., without the high bits that select the table. As the hash is invertible, the table and the key restore the k-mer.
+ */
+struct quotient_t {
+    uint8_t byte[7] = {};
+
+    quotient_t() = default;
+    explicit quotient_t(uint64_t bits) {for (auto& b : byte) {b = bits; bits >>= 8;}}
+    uint64_t bits() const {uint64_t bits = 0; for (int i = 6; i >= 0; --i) {bits = bits << 8 | byte[i];} return bits;}
+
+    bool operator==(const quotient_t& other) const {return memcmp(byte, other.byte, sizeof(byte)) == 0;}
+    bool operator!=(const quotient_t& other) const {return !(*this == other);}
+};
+template<> struct std::hash<quotient_t> {
+    size_t operator()(const quotient_t& key) const noexcept {return key.bits();}    // the bucket bits of the k-mer hash
+};
+    typedef quotient_t kmer_key_t;
+#else    // the k-mer itself
+    typedef kmer_t kmer_key_t;
+#endif
 
 /**
  * A tree structure that is needed for generating a NEWICK string.
@@ -97,6 +185,156 @@ struct spinlock {
   }
 };
 
+/**
+ * A counter-based random number generator: the n-th number of a stream is the SplitMix64 finalizer of key + n.
+ * Streams do not share any state, i.e., any key (e.g. derived from seed, replicate and color) gives an independent stream.
+ */
+struct counter_rng {
+  using result_type = uint64_t;
+
+  explicit counter_rng(uint64_t key) : key(key) {}
+
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() { return UINT64_MAX; }
+
+  static uint64_t mix(uint64_t x) {
+    x ^= x >> 30; x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27; x *= 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+  }
+
+  result_type operator()() noexcept {
+    return mix(key + 0x9e3779b97f4a7c15ULL * ++counter);
+  }
+
+  uint64_t key;
+  uint64_t counter = 0;
+};
+
+/**
+ * A batch of k-mers (with their bins and colors) that is handed over to the thread owning their bins.
+ */
+template <typename K>
+struct kmer_batch {
+    struct entry {
+        K kmer;
+        uint_fast32_t bin;
+        uint16_t color;
+    };
+    vector<entry> entries;
+    kmer_batch<K>* next = nullptr;
+};
+
+/**
+ * The batches handed over to a thread, as a lock-free stack (one cache line per thread).
+ */
+template <typename K>
+struct alignas(64) kmer_inbox {
+    atomic<kmer_batch<K>*> head = {nullptr};
+};
+
+/**
+ * The sliding window of the last m k-mers of a sequence, as a monotone deque in a ring buffer:
+ * the k-mers in the deque increase (by their order, e.g. lexicographically or by hash value) from front to back,
+ * so the front is the minimizer of the window.
+ * Each k-mer is pushed and popped at most once, i.e., the cost per position does not depend on m.
+ */
+template <typename K, typename O = K>
+class minimizer_window {
+  public:
+    explicit minimizer_window(uint64_t m) : ring(m), m(m) {}
+
+    // forget all k-mers, e.g. behind an invalid character
+    void clear() { head = 0; size = 0; count = 0; last = UINT64_MAX; }
+
+    // add the next k-mer, returns true if the window is full and its minimizer is a new occurrence
+    bool push(const K& kmer, const O& order) {
+        if (size > 0 && ring[head].index + m <= count) {    // front k-mer has left the window
+            if (++head == m) head = 0;
+            --size;
+        }
+        while (size > 0 && order < ring[at(size-1)].order) --size;    // larger k-mers can never be minimal again
+        ring[at(size++)] = {order, kmer, count++};
+
+        if (count < m || ring[head].index == last) return false;
+        last = ring[head].index;
+        return true;
+    }
+
+    // add the next k-mer, ordered by itself
+    bool push(const K& kmer) { return push(kmer, kmer); }
+
+    // the minimizer of the current window and its order
+    const K& kmer() const { return ring[head].kmer; }
+    const O& order() const { return ring[head].order; }
+
+  private:
+    uint64_t at(uint64_t i) const { return head + i < m ? head + i : head + i - m; }
+
+    struct entry {
+        O order;
+        K kmer;
+        uint64_t index;    // position of the k-mer in the sequence
+    };
+    vector<entry> ring;
+    uint64_t m;
+    uint64_t head = 0;    // ring index of the front
+    uint64_t size = 0;    // number of k-mers in the deque
+    uint64_t count = 0;    // number of k-mers pushed so far
+    uint64_t last = UINT64_MAX;    // position of the last reported minimizer
+};
+
+/**
+ * The schemes to sample k-mers with a window of m k-mers (--window, --sampling).
+ */
+enum sampling_scheme : uint32_t {
+    lex_minimizers = 0,    // lexicographically smallest k-mer per window
+    hash_minimizers = 1,    // k-mer with the smallest hash value per window
+    open_syncmers = 2,    // k-mers whose first s-mer (s = k-m+1, in canonical orientation) is a smallest one
+    closed_syncmers = 3    // k-mers whose first or last s-mer is a smallest one
+};
+
+/**
+ * The ways to qualify a k-mer before it is placed into the hash table, depending on the coverage threshold (--qualify).
+ */
+enum insertion_mode : uint8_t {
+    direct_insert = 0,    // q <= 1: insert each k-mer
+    set_filter = 1,    // q = 2: insert a k-mer at its second occurrence (per file)
+    set_filter_table = 2,    // q = 2 for some genomes, individual q values
+    map_filter = 3,    // q > 2: count the occurrences of a k-mer (per file) until q
+    map_filter_table = 4    // q > 2 for some genomes, individual q values
+};
+
+/**
+ * The number of k-mers seen and sampled by a thread, aligned to a cache line (no false sharing among threads).
+ */
+struct alignas(64) sampling_counter {
+    uint64_t kmers = 0;
+    uint64_t sampled = 0;
+};
+
+/**
+ * The singleton counters of a thread, aligned to a cache line (no false sharing among threads).
+ * A single counter can become negative, if the thread promotes a singleton counted by another thread.
+ */
+struct alignas(64) singleton_counter {
+    int64_t count[maxN] = {};
+};
+
+/**
+ * The parameters and genomes of a k-mer index, i.e., everything needed to continue without the input files.
+ */
+struct index_info {
+    uint64_t k;    // k-mer length
+    uint64_t window;    // number of k-mers per minimizer window
+    sampling_scheme sampling;    // how k-mers are sampled from a window
+    uint64_t scaled;    // fraction 1/scaled of k-mers kept (by hash value)
+    bool amino;    // amino acid k-mers
+    bool reverse;    // merged with their reverse complements
+    vector<string> names;    // representative name per genome (color)
+    vector<vector<string>> files;    // sequence files per genome
+};
+
 
 
 /**
@@ -126,28 +364,53 @@ private:
 	static hash_set<kmerAmino_t> blacklist_amino;	
 	
     /**
-     * This int indicates the number of tables to use for hashing
+     * This int indicates the number of tables to use for hashing, a power of two (2**table_bits)
      */
     static uint64_t table_count;
-    
-    /**
-     * This vector holds the carries of 2**i % table_count for fast distribution of bitset represented kmers
-     */
-    static vector<uint_fast32_t> period;
+    static constexpr uint64_t table_bits = 14;
     /**
      * This is a vector of hash tables mapping k-mers to colors [O(1)].
      */
-    static vector<hash_map<kmer_t, color_t>> kmer_table;
+    static vector<hash_map<kmer_key_t, kmer_color_t>> kmer_table;
 
     /**
      * This is a vector of spinlocks protecting the hash tables.
      */
     static vector<spinlock> lock;
 
+    /**
+     * This indicates that each thread owns a range of hash tables and inserts all k-mers of its tables,
+     * i.e., k-mers are routed to their owner in batches instead of locking the tables.
+     */
+    static bool sharded;
+    static uint64_t thread_count;
+
+    /**
+     * This is the number of k-mers per batch routed to an owner.
+     */
+    static const uint64_t batch_size = 512;
+
+    /**
+     * These are the batches currently filled by each thread, one per owner.
+     */
+    static vector<vector<kmer_batch<kmer_t>*>> outbox;
+    static vector<vector<kmer_batch<kmerAmino_t>*>> outbox_amino;
+
+    /**
+     * These are the batches handed over to each owner, but not inserted yet.
+     */
+    static vector<kmer_inbox<kmer_t>> inbox;
+    static vector<kmer_inbox<kmerAmino_t>> inbox_amino;
+
+    /**
+     * This is the number of threads that have no more k-mers to route.
+     */
+    static atomic<uint64_t> finished_threads;
+
     /**
      * This is a hash table mapping k-mers to colors [O(1)].
      */
-    static vector<hash_map<kmerAmino_t, color_t>> kmer_tableAmino;
+    static vector<hash_map<kmerAmino_t, kmer_color_t>> kmer_tableAmino;
 
 
     /**
@@ -156,10 +419,105 @@ private:
     static vector<hash_set<kmer_t>> quality_set;
     static vector<hash_set<kmerAmino_t>> quality_setAmino;
 
-	static vector<hash_map<kmer_t, uint16_t>> singleton_kmer_table;
+  #if !defined(useUnified)    // otherwise, the singleton k-mers are in the k-mer tables (-DuseUnified)
+	static vector<hash_map<kmer_key_t, uint16_t>> singleton_kmer_table;
 	static vector<hash_map<kmerAmino_t, uint16_t>> singleton_kmer_tableAmino;
-	static uint64_t singleton_counters[];
-	static spinlock singleton_counters_locks[];
+  #endif
+	static vector<singleton_counter> singleton_counters;
+
+    /**
+     * This is the scheme to sample k-mers with a window, and the number of k-mers seen and sampled per thread.
+     */
+    static sampling_scheme sampling;
+    static vector<sampling_counter> sampling_counters;
+
+    /**
+     * This is the max. hash value of a k-mer to be kept (scaled sketch), and the factor to rescale the k-mer counts of a split.
+     */
+    static uint64_t scaled_bound;
+    static uint32_t weight_scale;
+
+    /**
+     * These are the numbers of k-mers only known from loaded split counts or freed partitions, i.e., not in the tables.
+     */
+	static uint64_t loaded_kmers;
+	static uint64_t loaded_singleton_kmers;
+
+    /**
+     * These are the partitions of the k-mers on disk (--max-memory): while reading, the k-mers and their genomes are
+     * written to the partition of their bin (the high bits of the bin) instead of the tables, each thread buffering
+     * a few records per partition. Then, the partitions are inserted into the tables group by group.
+     */
+    static bool partitioned;
+    static uint64_t max_memory;
+    static constexpr uint64_t partition_bits = 8;
+    static const uint64_t partition_buffer = 2048;    // records per thread and partition, sorted and deduplicated
+    static vector<FILE*> partition_files;
+    static vector<uint64_t> partition_records;
+    static vector<spinlock> partition_lock;
+    static vector<vector<vector<pair<kmer_t, uint16_t>>>> partition_buffers;
+    static vector<vector<vector<pair<kmerAmino_t, uint16_t>>>> partition_buffers_amino;
+
+    /**
+     * This function writes a k-mer and its genome to the partition of its bin (--max-memory).
+     * @param T The id of the current thread
+     * @param bin Index of the target hash map
+     * @param kmer The k-mer
+     * @param color The genome
+     */
+    template <typename K>
+    static void partition_kmer(const uint64_t& T, const uint_fast32_t& bin, const K& kmer, const uint16_t& color);
+
+    /**
+     * This function iterates over the hash tables and adds the split weights to the color table (see add_weights).
+     * @param verbose print progress
+     */
+    static void add_table_weights(bool& verbose);
+
+    /**
+     * This is the number of k-mers per (not yet represented) color set in the k-mer tables, if known from an index.
+     * While it is tracked, each thread records the changes of the color sets by adding k-mers.
+     */
+	static bool track_colors;
+	static hash_map<color_t, uint64_t> kmer_colors;
+	static vector<hash_map<color_t, int64_t>> color_deltas;
+
+  #if defined(useClasses)
+    /**
+     * These are the color classes (-DuseClasses): the distinct color sets of the k-mers, by id (0 = empty set),
+     * the ids of the color sets, and a lock protecting both while the tables are filled.
+     */
+    static vector<color_t> class_colors;
+    static hash_map<color_t, uint32_t> class_ids;
+    static spinlock class_lock;
+
+    /**
+     * This is the transition cache of each thread, mapping a color class and an added color to the resulting class.
+     */
+    static vector<hash_map<uint64_t, uint32_t>> class_transitions;
+    static const uint64_t transition_limit = 0b1u << 20;    // the cache is cleared when this size is reached
+
+    /**
+     * These are the changes of the number of k-mers per color class recorded by each thread, see class_counts.
+     */
+    static vector<vector<int64_t>> class_deltas;
+
+  #if defined(useUnified)
+    /**
+     * This bit marks a singleton k-mer in the k-mer tables (-DuseUnified), the other bits are its genome, not a class.
+     */
+    static const uint32_t singleton_tag = 0b1u << 31;
+  #endif
+
+    /**
+     * This function tells the color class of the color set of a class with one more color (via the transition cache).
+     * @param T The id of the current thread
+     * @param id color class
+     * @param color color to add
+     * @return color class of the extended color set
+     */
+    static uint32_t next_class(const uint64_t& T, const uint32_t& id, const uint16_t& color);
+  #endif
 
 	
 	
@@ -172,11 +530,13 @@ private:
 public:
 
 	/**
-	* This function generates a bootstrap replicate. We mimic drawing n k-mers at random with replacement from all n observed k-mers. Say a k-mer would be drawn x times. Instead, we calculate x for each k-mer (in each split in color_table) from a binomial distribution (n repetitions, 1/n success rate) and calculate a new split weight according to the new number of k-mers.
+	* This function generates a bootstrap replicate. We mimic drawing n k-mers at random with replacement from all n observed k-mers. Say a k-mer would be drawn x times. Instead, we calculate x for each split (in color_table) with w k-mers at once from a binomial distribution (w*n repetitions, 1/n success rate) and calculate a new split weight according to the new number of k-mers.
 	* @param mean weight function
+	* @param seed the seed of the random numbers
+	* @param replicate the number of the replicate (each replicate and split draws from its own random stream)
 	* @return the new list of splits of length at least t ordered by weight as usual
 	*/
-	static multimap_<double, color_t> bootstrap(double mean(uint32_t&, uint32_t&));
+	static multimap_<double, color_t> bootstrap(double mean(uint32_t&, uint32_t&), const uint64_t& seed, const uint64_t& replicate);
 
     /**
      * This is an ordered tree collecting the splits [O(log n)].
@@ -193,6 +553,14 @@ public:
     */
     static vector<char> allowedChars;
 
+    /**
+     * This table maps each (upper or lower case) allowed char to its binary code.
+     * Line breaks are marked to be skipped, all other chars are marked as invalid.
+     */
+    static uint_fast8_t char_code[256];
+    static const uint_fast8_t code_skip = 0xFE;
+    static const uint_fast8_t code_invalid = 0xFF;
+
     /**
      * This function initializes the top list size, coverage threshold, and allowed characters.
      *
@@ -204,8 +572,9 @@ public:
 	 * @param blacklist_amino amino k-mers to be ignored
      * @param bins hash_tables to use for parallel processing
      * @param thread_count the number of threads used for processing
+     * @param sharded route k-mers to the thread owning their hash table instead of locking
      */
-    static void init(uint64_t& top_size, bool isAmino, vector<int>& q_table, int& quality, hash_set<kmer_t>& blacklist, hash_set<kmerAmino_t>& blacklist_amino, uint64_t& thread_count);
+    static void init(uint64_t& top_size, bool isAmino, vector<int>& q_table, int& quality, hash_set<kmer_t>& blacklist, hash_set<kmerAmino_t>& blacklist_amino, uint64_t& thread_count, bool sharded);
 
 
 
@@ -214,50 +583,59 @@ public:
     */
     
     /**
-     * This function shift updates the bin of a kmer
-    */
-    static uint_fast32_t shift_update_bin(uint_fast32_t& bin, uint_fast8_t& left, uint_fast8_t& right);
-    
-    /**
-     * This method shift updates the reverse complement bin for a kmer
-    */
-    static uint_fast32_t shift_update_rc_bin(uint_fast32_t& rc_bin, uint_fast8_t& left, uint_fast8_t& right);
-
-    /**
-    * This function shift updates a bin for an amino kmer
-    */
-    static uint_fast32_t shift_update_amino_bin(uint_fast32_t& bin, kmerAmino_t& kmer, uint_fast8_t& right);
-
-    /**
-     *  This method computes the bin of a given kmer(slower than shift update)
+     * This function computes the bin of a given kmer, i.e., the high bits of its hash.
+     * The hash tables pick their buckets by the low bits, so both are independent.
      * @param kmer The target kmer
      * @return uint64_t The bin
      */
-     
     static uint_fast32_t compute_bin(const kmer_t& kmer);
 
     /**
-     *  This function computes the bin of a given amino kmer(slower than shift update)
+     * This function computes the bin of a given amino kmer, i.e., the high bits of its hash.
      * @param kmer The target kmer
      * @return uint64_t The bin
      */
     static uint_fast32_t compute_amino_bin(const kmerAmino_t& kmer);
 
+    /**
+     * This function computes the key of a given kmer in its hash table, i.e., the low bits of its hash (-DuseQuotient).
+     * @param kmer The target kmer
+     * @return kmer_key_t The key
+     */
+    static kmer_key_t compute_key(const kmer_t& kmer);
+
+    /**
+     * This function restores a kmer from the bin and the key in its hash table.
+     * @param bin The bin
+     * @param key The key
+     * @return kmer_t The kmer
+     */
+    static kmer_t restore_kmer(const uint_fast32_t& bin, const kmer_key_t& key);
+
     /**
      * This function hashes a base k-mer and stores it in the corresponding hash table
+     *  @param T     The id of the current thread
      *  @param bin   Index of the target hash map 
      *  @param kmer  The k-mer to store
      *  @param color The color to store 
      */
-    static void hash_kmer(uint_fast32_t& bin, const kmer_t& kmer, const uint16_t& color);
+    static void hash_kmer(const uint64_t& T, uint_fast32_t& bin, const kmer_t& kmer, const uint16_t& color);
 
     /**
      * This function hashes an amino k-mer and stores it in the correstponding hash table
-     *  @param t_id The id of the current thread
+     *  @param T     The id of the current thread
+     *  @param bin   Index of the target hash map 
      *  @param kmer The kmer to store
      *  @param color The color to store 
      */
-    static void hash_kmer_amino(uint_fast32_t& bin, const kmerAmino_t& kmer, const uint16_t& color);
+    static void hash_kmer_amino(const uint64_t& T, uint_fast32_t& bin, const kmerAmino_t& kmer, const uint16_t& color);
+
+    /**
+     * This function hands over the remaining k-mers of a thread to their owners and, as an owner,
+     * inserts all k-mers routed to this thread until all threads are done (only if sharded).
+     *  @param T The id of the current thread
+     */
+    static void finish_thread(const uint64_t& T);
 
     /**
      * This function searches the bit-wise corresponding hash table for the given kmer
@@ -288,6 +666,91 @@ public:
      */
     static color_t get_color_amino(const kmerAmino_t& kmer);
 
+    /**
+     * This function returns the color set of a k-mer table entry, i.e., of its color class (-DuseClasses).
+     * @param value value of a k-mer table
+     * @return color_t The color set
+     */
+  #if defined(useHybrid)
+    static color_t color_of(const kmer_color_t& value) {
+        return value.colors();
+    }
+  #else
+    static const color_t& color_of(const kmer_color_t& value) {
+      #if defined(useClasses)
+        return class_colors[value];
+      #else
+        return value;
+      #endif
+    }
+  #endif
+
+  #if defined(useUnified)
+    /**
+     * This function tells if a k-mer table entry is a singleton, i.e., a k-mer of a single genome so far (-DuseUnified).
+     * @param value value of a k-mer table
+     * @param color the genome of a singleton
+     * @return true, if the k-mer is a singleton
+     */
+    static bool is_singleton(const kmer_color_t& value, uint16_t& color) {
+      #if defined(useClasses)
+        color = value & ~singleton_tag;
+        return value & singleton_tag;
+      #elif defined(useHybrid)
+        return value.is_singleton(color);
+      #else
+        if (!color::is_singleton(value)) return false;
+        color = value.tzcnt();
+        return true;
+      #endif
+    }
+
+    /**
+     * This function returns the k-mer table entry of a singleton k-mer (-DuseUnified).
+     * @param color the genome of the k-mer
+     * @return value of a k-mer table
+     */
+    static kmer_color_t singleton_value(const uint16_t& color) {
+      #if defined(useClasses)
+        return singleton_tag | color;
+      #else
+        kmer_color_t value;
+        value.set(color);
+        return value;
+      #endif
+    }
+  #endif
+
+  #if defined(useHybrid)
+    /**
+     * Get the number of k-mers with their color set stored as a list or as a bitset (-DuseHybrid).
+     * @param lists number of k-mers with a list of colors
+     * @param bitsets number of k-mers with a bitset
+     */
+    static void count_representations(uint64_t& lists, uint64_t& bitsets);
+  #endif
+
+  #if defined(useClasses)
+    /**
+     * This function returns the color class of a color set, a new one if the color set is not known yet.
+     * @param color The color set
+     * @return uint32_t The color class
+     */
+    static uint32_t intern_class(const color_t& color);
+
+    /**
+     * This function returns the number of k-mers per color class, summed up over the changes recorded by all threads.
+     * @return number of k-mers by color class
+     */
+    static vector<uint64_t> class_counts();
+
+    /**
+     * Get the number of color classes, i.e., of distinct color sets (incl. the empty one).
+     * @return number of color classes
+     */
+    static uint64_t number_classes();
+  #endif
+
 
     /**
      * This function removes the kmer entry from the hash map
@@ -313,25 +776,50 @@ public:
 	 * This function activates using the blacklist while inserting kmers.
 	 */
 	static void activate_blacklist();
+
+    /**
+     * This function sets the scheme to sample k-mers with a window (see add_minimizers).
+     *
+     * @param scheme sampling scheme
+     */
+    static void init_sampling(sampling_scheme scheme);
+
+    /**
+     * This function tells the fraction of k-mers sampled with a window so far.
+     *
+     * @param kmers number of k-mers seen
+     * @param sampled number of k-mers sampled
+     * @return the sampling density, i.e., sampled / kmers
+     */
+    static double sampling_density(uint64_t& kmers, uint64_t& sampled);
+
+    /**
+     * This function sets a scaled sketch: only the k-mers with a hash value below 2^64/scaled are kept.
+     *
+     * @param scaled fraction 1/scaled of k-mers kept (1 keeps all k-mers)
+     * @param rescale multiply the k-mer counts of each split by scaled before weighting
+     */
+    static void init_scaled(uint64_t scaled, bool rescale);
 	
     /**
      * This function extracts k-mers from a sequence and adds them to the hash table.
      *
-     * @param str dna sequence
+     * @param str dna sequence (upper or lower case, line breaks are skipped)
      * @param color color flag
      * @param reverse merge complements
      */
-    static void add_kmers(uint64_t& T, string& str, uint16_t& color, bool& reverse);
+    static void add_kmers(uint64_t& T, string_view str, uint16_t& color, bool& reverse);
 
     /**
-     * This function extracts k-mer minimizers from a sequence and adds them to the hash table.
+     * This function samples k-mers from a sequence with a window of m k-mers and adds them to the hash table.
+     * Depending on the sampling scheme, these are (lexicographic or hash-ordered) minimizers or syncmers.
      *
-     * @param str dna sequence
+     * @param str dna sequence (upper or lower case, line breaks are skipped)
      * @param color color flag
      * @param reverse merge complements
      * @param m number of k-mers to minimize
      */
-    static void add_minimizers(uint64_t& T, string& str, uint16_t& color, bool& reverse, uint64_t& m);
+    static void add_minimizers(uint64_t& T, string_view str, uint16_t& color, bool& reverse, uint64_t& m);
 
     /**
      * This function extracts k-mers from a sequence and adds them to the hash table.
@@ -382,6 +870,86 @@ public:
 	*/
 	static uint64_t number_singleton_kmers();
 
+	/**
+	* Get the quality of the k-mer hash: the balance of the bins, and the fraction of colliding k-mers.
+	* @param balance size of the largest bin relative to the mean bin size
+	* @return fraction of k-mers beyond the first one per home bucket (the first bucket probed) of a table
+	*/
+	static double kmer_collisions(double& balance);
+
+	/**
+	* Get the quality of the color hash, i.e., the fraction of colliding colors in the color table.
+	* @return fraction of colors beyond the first one per home bucket (the first bucket probed)
+	*/
+	static double color_collisions();
+
+	/**
+	* This function writes the k-mer tables, the singleton tables and counters, and the genomes to a binary file.
+	* (To call befor add_weights)
+	* @param file_name index file
+	* @param info parameters and genomes of the index
+	* @return false, if the file could not be written
+	*/
+	static bool save_index(const string& file_name, const index_info& info);
+
+	/**
+	* This function reads the parameters and genomes of an index file (To call before init).
+	* @param file_name index file
+	* @param info parameters and genomes of the index
+	* @return false, if the file is not a valid index for this build (maxK, maxN)
+	*/
+	static bool read_index_info(const string& file_name, index_info& info);
+
+	/**
+	* This function fills the k-mer tables, the singleton tables and counters from an index file (To call after init).
+	* @param file_name index file
+	* @return false, if the file is not a valid index for this build
+	*/
+	static bool load_index(const string& file_name);
+
+	/**
+	* This function lets the k-mers be written to partitions on disk instead of the tables (--max-memory, to call after init),
+	* so that only a group of partitions has to fit into memory at a time (see add_partitions).
+	* @param memory the memory budget of the tables in bytes
+	* @param folder folder of the temporary partition files
+	* @return false, if the partition files could not be created
+	*/
+	static bool init_partitions(const uint64_t& memory, const string& folder);
+
+	/**
+	* This function inserts the partitions into the tables group by group, as many as fit into the memory budget.
+	* Each group is accumulated into the color table, its core k-mers are output, and its tables are freed.
+	* (To call after reading, before add_weights)
+	* @param core output stream of the core k-mers, or nullptr
+	* @param verbose print progress
+	* @return false, if a partition file could not be read
+	*/
+	static bool add_partitions(ostream* core, bool& verbose);
+
+	/**
+	* This function writes the color table, i.e., the counts of all splits, and the genomes to a binary file.
+	* (To call after add_weights and add_singleton_weights)
+	* @param file_name split counts file
+	* @param info parameters and genomes
+	* @return false, if the file could not be written
+	*/
+	static bool save_counts(const string& file_name, const index_info& info);
+
+	/**
+	* This function reads the parameters and genomes of a split counts file (To call before init).
+	* @param file_name split counts file
+	* @param info parameters and genomes
+	* @return false, if the file is not a valid split counts file for this build (maxN)
+	*/
+	static bool read_counts_info(const string& file_name, index_info& info);
+
+	/**
+	* This function fills the color table from a split counts file (To call after init).
+	* @param file_name split counts file
+	* @return false, if the file is not a valid split counts file for this build
+	*/
+	static bool load_counts(const string& file_name);
+
 	/**
      * This function iterates over the hash table and calculates the split weights.
      *
@@ -490,23 +1058,89 @@ public:
 
 protected:
 
+    /**
+     * This function stores a k-mer in its hash table, the caller has to hold the lock or own the bin.
+     *  @param T     The id of the current thread (for counting singletons)
+     *  @param bin   Index of the target hash map 
+     *  @param kmer  The k-mer to store
+     *  @param color The color to store 
+     */
+    static void store_kmer(const uint64_t& T, const uint_fast32_t& bin, const kmer_t& kmer, const uint16_t& color);
+    static void store_kmer_amino(const uint64_t& T, const uint_fast32_t& bin, const kmerAmino_t& kmer, const uint16_t& color);
+
+    /**
+     * This function sums up the singleton counters of all threads for the given genome.
+     *  @param color The genome
+     *  @return The number of singleton k-mers of this genome
+     */
+    static uint64_t singleton_count(const uint16_t& color);
+
+    /**
+     * This function rescales the k-mer counts of a split from a scaled sketch to all k-mers.
+     *  @param counts k-mer counts of a split and its inverse
+     */
+    static void scale_counts(array<uint32_t,2>& counts);
+
+    /**
+     * This function adds a k-mer to the batch for the thread owning its bin.
+     *  @param T     The id of the current thread
+     *  @param bin   Index of the target hash map 
+     *  @param kmer  The k-mer to route
+     *  @param color The color to store 
+     */
+    static void route_kmer(const uint64_t& T, const uint_fast32_t& bin, const kmer_t& kmer, const uint16_t& color);
+    static void route_kmer_amino(const uint64_t& T, const uint_fast32_t& bin, const kmerAmino_t& kmer, const uint16_t& color);
+
+    /**
+     * This function inserts all k-mers that have been handed over to the given thread.
+     *  @param T The id of the owning thread
+     */
+    static void drain_inbox(const uint64_t& T);
+
+    /**
+     * This is the way to qualify k-mers, and whether k-mers are looked up in the blacklist before.
+     */
+    static insertion_mode insertion;
+    static bool blacklisted;
+
     /**
      * This function qualifies a k-mer and places it into the hash table.
+     * The insertion mode and blacklist are compile-time parameters, so the whole pipeline is inlined into the hashing loop.
      *
+     * @param T the id of the current thread
+     * @param bin index of the target hash map
      * @param kmer bit sequence
      * @param color color flag
      */
-    static function<void(const uint64_t& T, uint_fast32_t& bin, const kmer_t&, const uint16_t&)> emplace_kmer;
-    static function<void(const uint64_t& T, uint_fast32_t& bin, const kmer_t&, const uint16_t&)> emplace_kmer_tmp;
+    template <insertion_mode Q, bool B>
+    static void emplace_kmer(const uint64_t& T, uint_fast32_t& bin, const kmer_t& kmer, const uint16_t& color);
+    template <insertion_mode Q, bool B>
+    static void emplace_kmer_amino(const uint64_t& T, uint_fast32_t& bin, const kmerAmino_t& kmer, const uint16_t& color);
 
     /**
-     * This function qualifies a k-mer and places it into the hash table.
+     * This function qualifies a k-mer and places it into the hash table, choosing the pipeline at run time.
      *
+     * @param T the id of the current thread
+     * @param bin index of the target hash map
      * @param kmer bit sequence
      * @param color color flag
      */
-    static function<void(const uint64_t& T, uint_fast32_t& bin, const kmerAmino_t&, const uint16_t&)> emplace_kmer_amino;
-    static function<void(const uint64_t& T, uint_fast32_t& bin, const kmerAmino_t&, const uint16_t&)> emplace_kmer_amino_tmp;
+    static void emplace_kmer(const uint64_t& T, uint_fast32_t& bin, const kmer_t& kmer, const uint16_t& color);
+    static void emplace_kmer_amino(const uint64_t& T, uint_fast32_t& bin, const kmerAmino_t& kmer, const uint16_t& color);
+
+    /**
+     * These functions extract k-mers (or sample k-mers with a window) from a sequence and add them to the hash table,
+     * specialized for the insertion mode (Q), blacklist (B), and merging of complements (R).
+     *
+     * @param T the id of the current thread
+     * @param str dna sequence (upper or lower case, line breaks are skipped)
+     * @param color color flag
+     * @param m number of k-mers to minimize
+     */
+    template <insertion_mode Q, bool B, bool R>
+    static void extract_kmers(uint64_t& T, string_view str, uint16_t& color);
+    template <insertion_mode Q, bool B, bool R>
+    static void extract_minimizers(uint64_t& T, string_view str, uint16_t& color, uint64_t& m);
 
     /**
      * This function tests if a split is compatible with an existing set of splits.
@@ -5,6 +5,7 @@
  */
 size2K_t kmer::k;      // length of a k-mer (including gap positions)
 kmer_t   kmer::mask;   // bit-mask to erase all bits that exceed the k-mer length
+kmer_t   kmer::left_complement[4];   // complements of the bases at the leftmost position
 
 /**
  * This function initializes the k-mer length and bit-mask.
@@ -15,6 +16,11 @@ void kmer::init(const size2K_t& length) {
     k = length; mask = 0b0u;
     for (size2K_t i = 0; i < k; ++i)  // fill all bits within the k-mer length with ones
         (mask <<= 02u) |= 0b11u;     // the remaining zero bits can be used to mask bits
+    for (uint_fast8_t base = 0; base < 4; ++base) {
+        left_complement[base] = 0b11u - base;    // complement of the base
+        for (size2K_t i = 1; i < k; ++i)    // at the leftmost position
+            left_complement[base] <<= 02u;    // (multi-word k-mers only shift by less than a word at once)
+    }
 }
 
 /**
@@ -42,6 +48,17 @@ void kmer::shift(kmer_t& kmer, char& c_right) {
 }
 
 
+/**
+ * This function shifts a reverse complement k-mer appending the complement of a new character to the left,
+ * i.e., it keeps the reverse complement of a k-mer up to date while the character is shifted into the k-mer.
+ *
+ * @param rcmer bit sequence of the reverse complement
+ * @param right right character (of the k-mer) in binary-code
+ */
+void kmer::shift_reverse(kmer_t& rcmer, uint_fast8_t& right) {
+    rcmer >>= 02u;    // shift all current bits to the right by two positions
+    rcmer |= left_complement[right];    // encode the complement within the leftmost two bits
+}
 
 /**
  * This function unshifts a k-mer returning the character on the right.
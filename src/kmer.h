@@ -26,6 +26,11 @@ class kmer {
      */
     static kmer_t mask;
 
+    /**
+     * These are the complements of the four bases at the leftmost position of a k-mer.
+     */
+    static kmer_t left_complement[4];
+
  public:
 
     /**
@@ -58,6 +63,15 @@ class kmer {
     */
     static void shift(kmer_t& kmer, char& c_right);
 
+    /**
+     * This function shifts a reverse complement k-mer appending the complement of a new character to the left,
+     * i.e., it keeps the reverse complement of a k-mer up to date while the character is shifted into the k-mer.
+     *
+     * @param rcmer bit sequence of the reverse complement
+     * @param right right character (of the k-mer) in binary-code
+     */
+    static void shift_reverse(kmer_t& rcmer, uint_fast8_t& right);
+
     /**
      * This function unshifts a k-mer returning the character on the right.
      *
@@ -48,6 +48,18 @@ void kmerAmino::shift_right(kmerAmino_t& kmer, char& chr) {
     kmer &= mask;    // set all bits to zero that exceed the k-mer length
 }
 
+/**
+ * This function shifts a k-mer adding a new character to the right.
+ *
+ * @param kmer bit sequence
+ * @param right right character in binary-code
+ */
+void kmerAmino::shift_right(kmerAmino_t& kmer, uint_fast8_t& right) {
+    kmer <<= 05u;    // shift all current bits to the left by five positions
+    kmer |= right;    // encode the new character within the rightmost five bits
+    kmer &= mask;    // set all bits to zero that exceed the k-mer length
+}
+
 /**
  * This function unshifts a k-mer returning the character on the right.
  *
@@ -56,6 +56,14 @@ class kmerAmino {
      * @param c right character
      */
     static void shift_right(kmerAmino_t& kmer, char& c);
+
+    /**
+     * This function shifts a k-mer adding a new character to the right.
+     *
+     * @param kmer bit sequence
+     * @param right right character in binary-code
+     */
+    static void shift_right(kmerAmino_t& kmer, uint_fast8_t& right);
 	
 	/**
 	* This function unshifts a k-mer returning the character on the right.
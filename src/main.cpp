@@ -3,6 +3,7 @@
 #include <regex>
 // gzstream imports
 #include "gz/gzstream.h"
+#include "reader.h"
 
 /**
  * This is the entry point of the program.
@@ -42,7 +43,16 @@ int main(int argc, char* argv[]) {
         cout << endl;
         cout << "    -B, --blacklist\t File (Fasta, Fastq) of k-mers to be ignored" << endl;
         cout << endl;
-        cout << "    (either --input and/or --graph, or --splits must be provided)" << endl;
+        cout << "    --load-index  \t Index file: load the k-mers of a previous run (see --save-index)" << endl;
+        cout << "                  \t instead of reading the sequence files again" << endl;
+        cout << endl;
+        cout << "    --add         \t Add the genomes of --input to the genomes of --load-index" << endl;
+        cout << "                  \t (only the new sequence files are read, see also --save-index)" << endl;
+        cout << endl;
+        cout << "    --load-counts \t Split counts file: load the split counts of a previous run" << endl;
+        cout << "                  \t (see --save-counts), e.g. to try another --mean or --filter" << endl;
+        cout << endl;
+        cout << "    (either --input and/or --graph, --load-index, --load-counts, or --splits must be provided)" << endl;
         cout << endl;
         cout << "  Output arguments:" << endl;
         cout << endl;
@@ -68,6 +78,11 @@ int main(int argc, char* argv[]) {
         cout << endl;
         cout << "    -R, --raw  \t Output both counts per split in TSV file" << endl;
         cout << endl;
+        cout << "    --save-index  \t Output index file: the k-mers read, to be reused by --load-index" << endl;
+        cout << endl;
+        cout << "    --save-counts \t Output split counts file: the counts of all splits (before weighting" << endl;
+        cout << "                  \t and filtering), to be reused by --load-counts" << endl;
+        cout << endl;
         cout << "    (at least --output, --newick, --nexus, --pdf, --svg, --core, or --raw must be provided)" << endl;
         cout << endl;
         cout << "  Optional arguments:" << endl;
@@ -76,6 +91,17 @@ int main(int argc, char* argv[]) {
         cout << endl;
         // cout << "    -w, --window  \t Number of k-mers per minimizer window (default: 1)" << endl;
         // cout << endl;
+        cout << "    --scaled      \t Keep only the k-mers with a hash value below 2^64/<integer>," << endl;
+        cout << "                  \t i.e., a fraction 1/<integer> of all k-mers, the same in all genomes" << endl;
+        cout << "                  \t optional: rescale, multiply the k-mer counts of each split by <integer>" << endl;
+        cout << "                  \t (e.g. --scaled 100 rescale)" << endl;
+        cout << endl;
+        cout << "    --sampling    \t Sampling of k-mers with --window (default: lex)" << endl;
+        cout << "                  \t options: lex:    lexicographic minimizers" << endl;
+        cout << "                  \t          hash:   minimizers in random (hash) order" << endl;
+        cout << "                  \t          open:   open syncmers (smallest s-mer first, s = k-window+1)" << endl;
+        cout << "                  \t          closed: closed syncmers (smallest s-mer first or last)" << endl;
+        cout << endl;
         cout << "    -t, --top     \t Number of splits in the output list (default: all)." << endl;
         cout << "                  \t Use -t <integer>n to limit relative to number of input files, or" << endl;
         cout << "                  \t use -t <integer> to limit by absolute value." << endl;
@@ -120,6 +146,8 @@ int main(int argc, char* argv[]) {
         cout << "    -b, --bootstrap \t Perform bootstrapping with the specified number of replicates" << endl;
         cout << "                  \t optional: provide threshold to filter low support splits (e.g. 0.75)" << endl;
         cout << endl;
+        cout << "    --seed        \t Seed for the random numbers of the bootstrap replicates (default is random)" << endl;
+        cout << endl;
         cout << "    -C, --consensus\t Apply final filter w.r.t. support values" << endl;
         cout << "                  \t else: final filter w.r.t. split weights" << endl;
         cout << "                  \t optional: specify separate filter (see --filter for available filters.)" << endl;
@@ -135,6 +163,12 @@ int main(int argc, char* argv[]) {
         cout << endl;
         cout << "    -T, --threads \t The number of threads to spawn (default is all)" << endl;
         cout << endl;
+        cout << "    --shard       \t Each thread owns a range of hash tables, k-mers are handed over" << endl;
+        cout << "                  \t to their owner in batches instead of locking the tables" << endl;
+        cout << endl;
+        cout << "    --max-memory  \t Memory budget of the k-mer tables in MB: the k-mers are written" << endl;
+        cout << "                  \t to temporary files (in $TMPDIR or /tmp) and counted part by part" << endl;
+        cout << endl;
         cout << "    -h, --help    \t Display this help page and quit" << endl;
         cout << endl;
         cout << "  Contact: pangenomics-service@cebitec.uni-bielefeld.de" << endl;
@@ -169,6 +203,11 @@ int main(int argc, char* argv[]) {
     string groups; // name of input file giving groups
     string coloring; // name of input file for using specified color
     string translate; // name of translate file
+    string save_index_file; // name of index output file
+    string load_index_file; // name of index input file
+    string save_counts_file; // name of split counts output file
+    string load_counts_file; // name of split counts input file
+    bool add = false; // add the input genomes to the loaded index
 
     // input
     uint64_t num = 0;    // number of input files
@@ -181,6 +220,10 @@ int main(int argc, char* argv[]) {
     bool userKmer = false; // is k-mer default or custom
     uint64_t kmer = 31;    // length of k-mers
     uint64_t window = 1;    // number of k-mers in a minimizer window
+    sampling_scheme sampling = lex_minimizers;    // how k-mers are sampled from a window
+    bool userSampling = false;    // is the sampling scheme default or custom
+    uint64_t scaled = 1;    // keep a fraction 1/scaled of all k-mers
+    bool rescale = false;    // multiply the k-mer counts of each split by scaled
 
     // kmer preprocessing and filtering
     bool reverse = true;    // consider reverse complement k-mers
@@ -202,11 +245,14 @@ int main(int argc, char* argv[]) {
 
     // parallel hashing
     uint64_t threads = thread::hardware_concurrency(); // The number of threads to run on (default is #cores including smt / ht)
+    bool shard = false; // route k-mers to the thread owning their hash table
+    uint64_t max_memory = 0; // memory budget of the k-mer tables in MB (0 = in memory)
 
     // bootsrapping
     string consensus_filter; // filter function for filtering after bootstrapping
 	uint32_t bootstrap_no=0; // = no bootstrapping
 	float bootstrap_threshold=0; // threshold to filter low support splits
+	uint64_t seed = random_device()(); // seed for the bootstrap replicates
 	hash_map<color_t, uint32_t> support_values; // hash_map for each original split with zero counts
 
     // qol
@@ -285,6 +331,25 @@ int main(int argc, char* argv[]) {
             catch_missing_dependent_args(argv[i + 1], argv[i]);
             blacklistfile = argv[++i];    // Blacklist file: load kmers to be ignored
         }
+        else if (strcmp(argv[i], "--load-index") == 0) {
+            catch_missing_dependent_args(argv[i + 1], argv[i]);
+            load_index_file = argv[++i];    // Index file: k-mers of a previous run
+        }
+        else if (strcmp(argv[i], "--save-index") == 0) {
+            catch_missing_dependent_args(argv[i + 1], argv[i]);
+            save_index_file = argv[++i];    // Index file: k-mers read in this run
+        }
+        else if (strcmp(argv[i], "--add") == 0) {
+            add = true;    // Add genomes to an index
+        }
+        else if (strcmp(argv[i], "--load-counts") == 0) {
+            catch_missing_dependent_args(argv[i + 1], argv[i]);
+            load_counts_file = argv[++i];    // Split counts file: color table of a previous run
+        }
+        else if (strcmp(argv[i], "--save-counts") == 0) {
+            catch_missing_dependent_args(argv[i + 1], argv[i]);
+            save_counts_file = argv[++i];    // Split counts file: color table of this run
+        }
         else if (strcmp(argv[i], "-o") == 0 || strcmp(argv[i], "--output") == 0) {
             catch_missing_dependent_args(argv[i + 1], argv[i]);
             output = argv[++i];    // Output file: list of splits, sorted by weight desc.
@@ -364,6 +429,37 @@ int main(int argc, char* argv[]) {
                 cerr << "Warning: using experimental feature --window" << endl;
             }
         }
+        else if (strcmp(argv[i], "--scaled") == 0) {
+            catch_missing_dependent_args(argv[i + 1], argv[i]);
+            catch_failed_stoi_cast(argv[i + 1], argv[i]);
+            scaled = stoi(argv[++i]);    // Keep a fraction 1/scaled of all k-mers
+            if (scaled < 1) {
+                cerr << "Error: --scaled requires a positive integer" << endl;
+                return 1;
+            }
+            if (i+1 < argc && strcmp(argv[i+1], "rescale") == 0) {
+                rescale = true;    // Estimate the counts of all k-mers
+                i++;
+            }
+        }
+        else if (strcmp(argv[i], "--sampling") == 0) {
+            catch_missing_dependent_args(argv[i + 1], argv[i]);
+            string scheme = argv[++i];    // Sampling of k-mers with --window
+            if (scheme == "lex") {
+                sampling = lex_minimizers;
+            } else if (scheme == "hash") {
+                sampling = hash_minimizers;
+            } else if (scheme == "open") {
+                sampling = open_syncmers;
+            } else if (scheme == "closed") {
+                sampling = closed_syncmers;
+            } else {
+                cerr << "Error: unknown sampling scheme: " << scheme << endl;
+                cerr << "       options: lex, hash, open, closed" << endl;
+                return 1;
+            }
+            userSampling = true;
+        }
         else if (strcmp(argv[i], "-t") == 0 || strcmp(argv[i], "--top") == 0) {
             catch_missing_dependent_args(argv[i + 1], argv[i]);
 			if (strcmp(argv[i+1],"all") != 0){ // if user selects "-t all", do nothing
@@ -499,6 +595,18 @@ int main(int argc, char* argv[]) {
                 if (!ask_for_user_confirmation()){return 0;}
             }
         }
+        else if (strcmp(argv[i], "--shard") == 0) {
+            shard = true;    // Lock-free insertion by table ownership
+        }
+        else if (strcmp(argv[i], "--max-memory") == 0) {
+            catch_missing_dependent_args(argv[i + 1], argv[i]);
+            catch_failed_stoi_cast(argv[i + 1], argv[i]);
+            max_memory = stoi(argv[++i]);    // Two-pass counting of the k-mers on disk
+            if (max_memory <= 0) {
+                cerr << "Error: --max-memory requires a memory budget of at least 1 MB" << endl;
+                return 1;
+            }
+        }
         // bootsrapping
         else if (strcmp(argv[i], "-b") == 0 || strcmp(argv[i], "--bootstrapping") == 0 || strcmp(argv[i], "--bootstrap") == 0) {
             catch_missing_dependent_args(argv[i + 1], argv[i]);
@@ -519,6 +627,15 @@ int main(int argc, char* argv[]) {
             }
 
         }
+        else if (strcmp(argv[i], "--seed") == 0) {
+            catch_missing_dependent_args(argv[i + 1], argv[i]);
+            try {
+                seed = stoull(argv[++i]);    // Reproducible bootstrap replicates
+            } catch (const std::exception& e) {
+                cerr << "Error: Could not read seed: " << argv[i] << endl;
+                exit(1);
+            }
+        }
         else if (strcmp(argv[i], "-C") == 0 || strcmp(argv[i], "--consensus") == 0) {
 			if (i+1 < argc && argv[i+1][0]!='-') {
 				consensus_filter = argv[++i];    // Filter a greedy maximum weight subset
@@ -596,8 +713,28 @@ int main(int argc, char* argv[]) {
         return 1;
     }
     
-    if (input.empty() && graph.empty()) {
-        cerr << "Error: missing argument: --input <file_name> or --graph <file_name>" << endl;
+    if (input.empty() && graph.empty() && load_index_file.empty() && load_counts_file.empty()) {
+        cerr << "Error: missing argument: --input <file_name> or --graph <file_name> or --load-index <file_name> or --load-counts <file_name>" << endl;
+        return 1;
+    }
+    if (!load_index_file.empty() && ((!input.empty() && !add) || !graph.empty() || !splits.empty())) {
+        cerr << "Error: too many input arguments: --load-index and --input (without --add), --graph or --splits" << endl;
+        return 1;
+    }
+    if (add && (load_index_file.empty() || input.empty())) {
+        cerr << "Error: --add requires an index (--load-index) and the genomes to add (--input)" << endl;
+        return 1;
+    }
+    if (!load_counts_file.empty() && (!input.empty() || !graph.empty() || !splits.empty() || !load_index_file.empty())) {
+        cerr << "Error: too many input arguments: --load-counts and --input, --graph, --splits or --load-index" << endl;
+        return 1;
+    }
+    if (!load_counts_file.empty() && (!core.empty() || !save_index_file.empty())) {
+        cerr << "Error: split counts do not contain k-mers for --core or --save-index" << endl;
+        return 1;
+    }
+    if (max_memory > 0 && (input.empty() || !load_index_file.empty() || !save_index_file.empty() || !graph.empty() || !splits.empty())) {
+        cerr << "Error: --max-memory requires --input, and does not keep the k-mers for --load-index, --save-index, --graph or --splits" << endl;
         return 1;
     }
 
@@ -623,7 +760,7 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
-    if (output.empty() && newick.empty() && nexus.empty() && pdf.empty() && svg.empty() && core.empty() && !raw_wanted) {
+    if (output.empty() && newick.empty() && nexus.empty() && pdf.empty() && svg.empty() && core.empty() && !raw_wanted && save_index_file.empty() && save_counts_file.empty()) {
         cerr << "Error: missing argument: --output <file_name> or --newick <file_name> or --nexus <file_name> or --pdf <file_name> or --svg <file_name> or --core <file_name> or --raw <file_name>" << endl;
         return 1;
     }
@@ -641,8 +778,9 @@ int main(int argc, char* argv[]) {
 		return 1;
     }
     if (kmer > maxK && splits.empty()) {
+        util::run_variant(argv, kmer, 0, maxK, maxN);    // a pre-built variant with a wider k-mer width, if any
         cerr << "Error: k-mer length exceeds -DmaxK=" << maxK << endl;
-        cerr << "Solution: Modify -DmaxK in makefile, run make, run SANS." << endl;
+        cerr << "Solution: Modify -DmaxK in makefile, run make, run SANS, or run make variants." << endl;
         return 1;
     }
     if (!newick.empty() && filter != "strict" && filter.find("tree") == -1 && consensus_filter.empty()) {
@@ -687,7 +825,7 @@ int main(int argc, char* argv[]) {
         cerr << "Note: Newick output from a list of splits, some taxa could be missing" << endl;
         cerr << "      --input can be used to provide the original list of taxa" << endl;
     }
-    if (input.empty() && graph.empty() && bootstrap_no>0){
+    if (input.empty() && graph.empty() && load_index_file.empty() && load_counts_file.empty() && bootstrap_no>0){
         cerr << "Error: Bootstrapping can only be applied with given sequence data (--input or --graph)" << endl;
 		return 1;
 	}
@@ -716,6 +854,22 @@ int main(int argc, char* argv[]) {
     // deduct default kmer size if not user defined
     if (!userKmer) {kmer = amino == true ? 10 : 31;}
 
+    if (userSampling && window <= 1) {
+        cerr << "Warning: --sampling has no effect without --window" << endl;
+    }
+    if (window > 1 && sampling != lex_minimizers && iupac > 1) {
+        cerr << "Error: using --iupac with --sampling other than lex is (currently) not supported" << endl;
+        return 1;
+    }
+    if (scaled > 1 && (window > 1 || iupac > 1 || !graph.empty())) {
+        cerr << "Error: using --scaled with --window, --iupac, or --graph is (currently) not supported" << endl;
+        return 1;
+    }
+    if (window > kmer && (sampling == open_syncmers || sampling == closed_syncmers)) {
+        cerr << "Error: syncmers require --window to be at most the k-mer length (s = k-window+1)" << endl;
+        return 1;
+    }
+
 
     /**
      *  [indexing]
@@ -737,7 +891,44 @@ int main(int argc, char* argv[]) {
     vector<string> denom_names; // storing the representative name per color
     vector<vector<string>> gen_files; // genome file collection
     vector<int> q_table; // q value (k-mer occurrence threshold) per genome/color
+    uint64_t first_genome = 0; // the first genome to read from the sequence files
 
+    // take the genomes and k-mer parameters from an index or split counts file
+    if (!load_index_file.empty() || !load_counts_file.empty()) {
+        index_info info;
+        if (!load_index_file.empty() && !graph::read_index_info(load_index_file, info)) {
+            cerr << "Error: could not read index file: " << load_index_file << endl;
+            return 1;
+        }
+        if (!load_counts_file.empty() && !graph::read_counts_info(load_counts_file, info)) {
+            cerr << "Error: could not read split counts file: " << load_counts_file << endl;
+            return 1;
+        }
+        if (userKmer && kmer != info.k) {
+            cerr << "Warning: setting k-mer length to match the given index. New length: " << info.k << endl;
+        }
+        if (userSampling && (sampling != info.sampling || window != info.window)) {
+            cerr << "Warning: setting --window and --sampling to match the given index" << endl;
+        }
+        kmer = info.k;
+        window = info.window;
+        sampling = info.sampling;
+        if (scaled != 1 && scaled != info.scaled) {
+            cerr << "Warning: setting --scaled to match the given index. New value: " << info.scaled << endl;
+        }
+        scaled = info.scaled;
+        amino = info.amino;
+        reverse = info.reverse;
+        for (uint64_t g = 0; g < info.names.size(); ++g) {
+            denom_names.push_back(info.names[g]);
+            name_table[info.names[g]] = num;
+            for (auto& file_name : info.files[g]) {name_table[file_name] = num;}
+            gen_files.push_back(info.files[g]);
+            num++;
+        }
+        first_genome = num;    // only genomes added to the index have to be read
+        q_table.assign(num, quality);
+    }
     
     if (!input.empty()) {
         // check the input file 
@@ -843,6 +1034,7 @@ int main(int argc, char* argv[]) {
         quality=max_q;
         if(max_q==min_q){q_table.clear();} // all q_values the same (=quality)
     }
+
     int denom_file_count = denom_names.size();
 
 	
@@ -1032,6 +1224,9 @@ int main(int argc, char* argv[]) {
      * - Update and check validity of input dependent meta variables
      */ 
 
+    // run the pre-built variant with the best-fitting k-mer and color widths, if any (see make variants)
+    util::run_variant(argv, kmer, num, maxK, maxN);
+
     // check if the number of genomes is reasonably close the maximal storable color set
     if (check_n) {
        util::check_n(num,path,maxN);
@@ -1040,7 +1235,7 @@ int main(int argc, char* argv[]) {
     // check if the number of genomes exceeds the maximal storable color set
     if (num > maxN) {
         cerr << "Error: number of input genomes ("<<num<<") exceeds -DmaxN=" << maxN << endl;
-        cerr << "Solution: modify -DmaxN in makefile, run make, run SANS; or use SANS-autoN.sh." << endl;
+        cerr << "Solution: modify -DmaxN in makefile, run make, run SANS; or use SANS-autoN.sh; or run make variants." << endl;
         return 1;
     }
     if (maxN-num>=100) {
@@ -1067,7 +1262,15 @@ int main(int argc, char* argv[]) {
     kmer::init(kmer);      // initialize the k-mer length
     kmerAmino::init(kmer); // initialize the k-mer length
     color::init(num);    // initialize the color number
-    graph::init(top, amino, q_table, quality, blacklist, blacklist_amino, threads); // initialize the toplist size and the allowed characters
+    graph::init(top, amino, q_table, quality, blacklist, blacklist_amino, threads, shard); // initialize the toplist size and the allowed characters
+    graph::init_sampling(sampling);
+    graph::init_scaled(scaled, rescale);
+    if (max_memory > 0) {
+        const char* folder = getenv("TMPDIR");    // the k-mers are written to disk
+        if (!graph::init_partitions(max_memory << 20, folder != nullptr ? folder : "/tmp")) {
+            return 1;
+        }
+    }
 
 	
 	/**
@@ -1133,6 +1336,38 @@ int main(int argc, char* argv[]) {
 	}
 
 
+
+    /**
+     *  ---> Index loading
+     *  - fill the tables from an index file instead of reading the sequences
+     */
+    if (!load_index_file.empty()) {
+        if (verbose) {
+            cout << "Loading index..." << flush;
+        }
+        if (!graph::load_index(load_index_file)) {
+            cerr << "Error: could not load index file: " << load_index_file << endl;
+            return 1;
+        }
+        if (verbose) {
+            end = chrono::high_resolution_clock::now();
+            cout << "\33[2K\r" << "Loading index... (" << util::format_time(end - begin) << ")" << endl << flush;
+        }
+    }
+    if (!load_counts_file.empty()) {
+        if (verbose) {
+            cout << "Loading split counts..." << flush;
+        }
+        if (!graph::load_counts(load_counts_file)) {
+            cerr << "Error: could not load split counts file: " << load_counts_file << endl;
+            return 1;
+        }
+        if (verbose) {
+            end = chrono::high_resolution_clock::now();
+            cout << "\33[2K\r" << "Loading split counts... (" << util::format_time(end - begin) << ")" << endl << flush;
+        }
+    }
+
 	
     /**
      *  ---> Split processing
@@ -1198,10 +1433,6 @@ int main(int argc, char* argv[]) {
 					file_name=folder+file_name;
 				}
 
-				char c_name[(file_name).length()]; // Create char array for c compatibilty
-				strcpy(c_name, (file_name).c_str()); // Transcire to char array
-
-				igzstream file(c_name, ios::in);    // input file stream
 				if (verbose) {     // print progress
 // 					cout << "\33[2K\r" << file_name;
 					if (q_table.size()>0) {
@@ -1213,76 +1444,91 @@ int main(int argc, char* argv[]) {
 					}
 					cout << ")" << endl;
 				}
-				count::deleteCount();
 
-				string appendixChars; 
-				string line;    // read the file line by line
-				while (getline(file, line)) {
-					if (line.length() > 0) {
-						if (line[0] == '>' || line[0] == '@') {    // FASTA & FASTQ header -> process
-							if (window > 1) {
-								iupac > 1 ? graph::add_minimizers(T, sequence, genome_ids[i], reverse, window, iupac)
-										: graph::add_minimizers(T, sequence, genome_ids[i], reverse, window);
-							} else {
-								iupac > 1 ? graph::add_kmers(T, sequence, genome_ids[i], reverse, iupac)
-										: graph::add_kmers(T, sequence, genome_ids[i], reverse);
-							}
+				reader seq_reader(file_name);    // memory-mapped input file, if uncompressed
+				if (seq_reader.mapped() && !shouldTranslate && iupac <= 1) {
+					string_view view;    // the sequences are processed directly on the mapped file
+					while (seq_reader.next(view)) {
+						window > 1 ? graph::add_minimizers(T, view, genome_ids[i], reverse, window)
+								: graph::add_kmers(T, view, genome_ids[i], reverse);
+					}
+				} else {    // compressed input, translation or ambiguous bases -> read line by line
+					char c_name[(file_name).length()]; // Create char array for c compatibilty
+					strcpy(c_name, (file_name).c_str()); // Transcire to char array
+
+					igzstream file(c_name, ios::in);    // input file stream
+					count::deleteCount();
+
+					string appendixChars; 
+					string line;    // read the file line by line
+					while (getline(file, line)) {
+						if (line.length() > 0) {
+							if (line[0] == '>' || line[0] == '@') {    // FASTA & FASTQ header -> process
+								if (window > 1) {
+									iupac > 1 ? graph::add_minimizers(T, sequence, genome_ids[i], reverse, window, iupac)
+											: graph::add_minimizers(T, sequence, genome_ids[i], reverse, window);
+								} else {
+									iupac > 1 ? graph::add_kmers(T, sequence, genome_ids[i], reverse, iupac)
+											: graph::add_kmers(T, sequence, genome_ids[i], reverse);
+								}
 
-							sequence.clear();
+								sequence.clear();
 
-//                            if (verbose) {
-//                                cout << "\33[2K\r" << line << flush << endl;    // print progress
-//                            }
-						}
-						else if (line[0] == '+') {    // FASTQ quality values -> ignore
-							getline(file, line);
-						}
-						else {
-							transform(line.begin(), line.end(), line.begin(), ::toupper);
-							string newLine = line;
-							if (shouldTranslate) {
-								if (appendixChars.length() >0 ) {
-									newLine= appendixChars + newLine;
-									appendixChars = "";
-								}
-								auto toManyChars = line.length() % 3;
-								if (toManyChars > 0) {
-									appendixChars = newLine.substr(line.length() - toManyChars, toManyChars);
-									newLine = newLine.substr(0, line.length() - toManyChars);
+//                                if (verbose) {
+//                                    cout << "\33[2K\r" << line << flush << endl;    // print progress
+//                                }
+							}
+							else if (line[0] == '+') {    // FASTQ quality values -> ignore
+								getline(file, line);
+							}
+							else {
+								transform(line.begin(), line.end(), line.begin(), ::toupper);
+								string newLine = line;
+								if (shouldTranslate) {
+									if (appendixChars.length() >0 ) {
+										newLine= appendixChars + newLine;
+										appendixChars = "";
+									}
+									auto toManyChars = line.length() % 3;
+									if (toManyChars > 0) {
+										appendixChars = newLine.substr(line.length() - toManyChars, toManyChars);
+										newLine = newLine.substr(0, line.length() - toManyChars);
+									}
+
+									newLine = translator::translate(newLine);
 								}
-
-								newLine = translator::translate(newLine);
+								sequence += newLine;    // FASTA & FASTQ sequence -> read
 							}
-							sequence += newLine;    // FASTA & FASTQ sequence -> read
 						}
 					}
-				}
-				if (verbose && count::getCount() > 0) {
-					cerr << count::getCount()<< " triplets could not be translated."<< endl;
-				}
-				if (window > 1) {
-					iupac > 1 ? graph::add_minimizers(T, sequence, genome_ids[i], reverse, window, iupac)
-							: graph::add_minimizers(T, sequence, genome_ids[i], reverse, window);
-				} else {
-					iupac > 1 ? graph::add_kmers(T, sequence, genome_ids[i], reverse, iupac)
-							: graph::add_kmers(T, sequence, genome_ids[i], reverse);
-				}
-				sequence.clear();
+					if (verbose && count::getCount() > 0) {
+						cerr << count::getCount()<< " triplets could not be translated."<< endl;
+					}
+					if (window > 1) {
+						iupac > 1 ? graph::add_minimizers(T, sequence, genome_ids[i], reverse, window, iupac)
+								: graph::add_minimizers(T, sequence, genome_ids[i], reverse, window);
+					} else {
+						iupac > 1 ? graph::add_kmers(T, sequence, genome_ids[i], reverse, iupac)
+								: graph::add_kmers(T, sequence, genome_ids[i], reverse);
+					}
+					sequence.clear();
 
 				
-// 				if (verbose) {
-// 					cout << "\33[2K\r" << flush;
-// 				}
-				file.close();
+// 					if (verbose) {
+// 						cout << "\33[2K\r" << flush;
+// 					}
+					file.close();
+				}
                 graph::clear_thread(T);
                 i = index_lambda();
             }
+            graph::finish_thread(T);    // insert the k-mers routed to this thread by the others
         }; // End of lambda expression
 
         // Driver code for multithreaded kmer hashing
 		vector<uint16_t> genome_ids; //unfold multiple files per genome to two flat lists, one listing the genome ids and one listing the file ids.
 		vector<uint16_t> file_ids;
-		for (int g=0;g<gen_files.size();g++){
+		for (int g=first_genome;g<gen_files.size();g++){
 			for (int f=0;f<gen_files[g].size();f++){
 				genome_ids.push_back(g);
 				file_ids.push_back(f);
@@ -1295,6 +1541,29 @@ int main(int argc, char* argv[]) {
 
     }
 
+    /**
+     * [partitions]
+     * - insert the k-mers written to disk part by part, accumulating the splits and core k-mers of each part
+     */
+    if (max_memory > 0) {
+        if (verbose) {
+            cout << "Inserting k-mers from disk..." << flush;
+        }
+        ofstream core_file;
+        ostream core_stream(nullptr);
+        if (!core.empty()) {
+            core_file.open(core);
+            core_stream.rdbuf(core_file.rdbuf());
+        }
+        if (!graph::add_partitions(core.empty() ? nullptr : &core_stream, verbose)) {
+            return 1;
+        }
+        if (verbose) {
+            end = chrono::high_resolution_clock::now();
+            cout << "\33[2K\r" << "Inserting k-mers from disk... (" << util::format_time(end - begin) << ")" << endl << flush;
+        }
+    }
+
     /**
      * ---> bifrost CDBG processing ---
      * - iterate all colored k-mers from a CDBG
@@ -1345,12 +1614,52 @@ double min_value = numeric_limits<double>::min(); // current minimal weight repr
 	       exit(0);
        }
         
-	if(verbose & ((!input.empty() && splits.empty()) || !graph.empty())){
+	if(verbose & ((!input.empty() && splits.empty()) || !graph.empty() || !load_index_file.empty() || !load_counts_file.empty())){
 		uint64_t s=graph::number_singleton_kmers();
 		uint64_t all=s+graph::number_kmers();
 		end = chrono::high_resolution_clock::now(); 
 		cout << all << " k-mers read." << flush;
 		cout << " (" << s << " / "<< (100*s/all) <<"% singleton k-mers)" << " (" << util::format_time(end - begin) << ")" << endl << flush;
+		uint64_t seen, sampled;
+		double density = graph::sampling_density(seen, sampled);
+		if (window > 1 && seen > 0) {
+			cout << "Sampling density: " << density << " (" << sampled << " of " << seen << " k-mers sampled)" << endl << flush;
+		}
+		if (splits.empty() && load_index_file.empty() && max_memory == 0) {
+			double balance, collisions = graph::kmer_collisions(balance);
+			cout << "Hash tables: largest bin " << balance << " times the mean, "
+			     << 100*collisions << "% of the k-mers collide" << endl << flush;
+		}
+	  #if defined(useHybrid)
+		if (max_memory == 0) {    // the tables are not kept with --max-memory
+			uint64_t lists, bitsets;
+			graph::count_representations(lists, bitsets);
+			cout << "Color sets: " << lists << " lists (" << lists*sizeof(hybrid_color_t)/1024 << " KiB), "
+			     << bitsets << " bitsets (" << bitsets*(sizeof(hybrid_color_t)+sizeof(color_t))/1024 << " KiB)" << endl << flush;
+		}
+	  #endif
+	  #if defined(useClasses)
+		cout << "Color classes: " << graph::number_classes() << " distinct color sets of "
+		     << graph::number_kmers() << " non-singleton k-mers" << endl << flush;
+	  #endif
+	}
+
+	/*
+	 * [index]
+	 * - store the tables to skip reading the sequences next time
+	 */
+	if (!save_index_file.empty() && splits.empty()) {
+		if (verbose) {
+			cout << "Writing index..." << flush;
+		}
+		if (!graph::save_index(save_index_file, {kmer, window, sampling, scaled, amino, reverse, denom_names, gen_files})) {
+			cerr << "Error: could not write index file: " << save_index_file << endl;
+			return 1;
+		}
+		if (verbose) {
+			end = chrono::high_resolution_clock::now();
+			cout << "\33[2K\r" << "Writing index... (" << util::format_time(end - begin) << ")" << endl << flush;
+		}
 	}
 
 	///DEBUGING////
@@ -1377,7 +1686,7 @@ double min_value = numeric_limits<double>::min(); // current minimal weight repr
 	/*
 	 * [core k-mers]
 	 */
-	if(!core.empty()){
+	if(!core.empty() && max_memory == 0){    // else, already output by part
 		// output file stream
 		ofstream core_file(core);
 		ostream core_stream(core_file.rdbuf());
@@ -1389,7 +1698,7 @@ double min_value = numeric_limits<double>::min(); // current minimal weight repr
 	
 
 	// if only core-kmers are asked for, no further processing necessary
-	if (!output.empty() || !newick.empty() || !nexus.empty() || !pdf.empty() || !svg.empty() || raw_wanted){ 
+	if (!output.empty() || !newick.empty() || !nexus.empty() || !pdf.empty() || !svg.empty() || raw_wanted || !save_counts_file.empty()){ 
 	
 		/*
 		* [graph processing]
@@ -1417,6 +1726,21 @@ double min_value = numeric_limits<double>::min(); // current minimal weight repr
 		if (verbose) {
 			end = chrono::high_resolution_clock::now();
 			cout << "\33[2K\r"  << "Accumulating splits from singleton k-mers... (" << util::format_time(end - begin) << ")" << endl;
+			cout << "Color table: " << 100*graph::color_collisions() << "% of the colors collide" << endl;
+		}
+
+		if (!save_counts_file.empty() && splits.empty()) {
+			if (verbose) {
+				cout << "Writing split counts..." << flush;
+			}
+			if (!graph::save_counts(save_counts_file, {kmer, window, sampling, scaled, amino, reverse, denom_names, gen_files})) {
+				cerr << "Error: could not write split counts file: " << save_counts_file << endl;
+				return 1;
+			}
+			if (verbose) {
+				end = chrono::high_resolution_clock::now();
+				cout << "\33[2K\r" << "Writing split counts... (" << util::format_time(end - begin) << ")" << endl << flush;
+			}
 		}
 
 
@@ -1477,15 +1801,15 @@ double min_value = numeric_limits<double>::min(); // current minimal weight repr
 			
 
 
-		// Thread safe implementation of getting the index of the next run
-			uint64_t index = 0;
-			std::mutex index_mutex;
-			std::mutex count_mutex;
-			auto index_lambda_bootstrap = [&] () {std::lock_guard<mutex> lg(index_mutex); return index++;};
-			
-			auto lambda_bootstrap_count = [&] (multimap_<double, color_t> split_list_bs, hash_map<color_t, uint32_t>& support_values) { std::lock_guard<mutex> lg(count_mutex); for (auto& it : split_list_bs){color_t colors = it.second;support_values[colors]++;}};
+		// Lock-free scheduling of the replicates, each replicate draws from its own random stream (seed, replicate)
+			atomic<uint64_t> index(0);
+			auto index_lambda_bootstrap = [&] () {return index.fetch_add(1, memory_order_relaxed);};
+
+			// Each thread counts the support of its replicates separately, the counts are merged after joining
+			vector<hash_map<color_t, uint32_t>> thread_support(threads);
+			auto lambda_bootstrap_count = [&] (multimap_<double, color_t>& split_list_bs, hash_map<color_t, uint32_t>& support_values) {for (auto& it : split_list_bs){support_values[it.second]++;}};
 
-			auto lambda_bootstrap = [&] (uint64_t T, uint64_t max){ // This lambda expression wraps the sequence-kmer hashing
+			auto lambda_bootstrap = [&] (uint64_t T, uint64_t max){ // This lambda expression wraps the bootstrapping
 				uint64_t i = index_lambda_bootstrap();
 				while (i<max){
 
@@ -1494,11 +1818,11 @@ double min_value = numeric_limits<double>::min(); // current minimal weight repr
 					}
 					
 					// create bootstrap replicate
-					multimap_<double, color_t>  split_list_bs = graph::bootstrap(mean);
+					multimap_<double, color_t>  split_list_bs = graph::bootstrap(mean, seed, i);
 					apply_filter(filter,"", map, split_list_bs,verbose);
 					
 					// count conserved splits
-					lambda_bootstrap_count(split_list_bs, support_values);
+					lambda_bootstrap_count(split_list_bs, thread_support[T]);
 					
 					// more to do for this thread?
 					i = index_lambda_bootstrap();
@@ -1506,16 +1830,27 @@ double min_value = numeric_limits<double>::min(); // current minimal weight repr
 			};
 			
 			// Driver code for multithreaded bootstrapping
+			auto bootstrap_begin = chrono::high_resolution_clock::now();
 			vector<thread> thread_holder(threads);
 			for (uint64_t thread_id = 0; thread_id < threads; ++thread_id){thread_holder[thread_id] = thread(lambda_bootstrap, thread_id, bootstrap_no);}
 			for (uint64_t thread_id = 0; thread_id < threads; ++thread_id){thread_holder[thread_id].join();}
 
+			// Merge the support counts of all threads (the sums do not depend on the distribution of the replicates)
+			for (auto& support : thread_support) {
+				for (auto it = support.begin(); it != support.end(); ++it) {
+					support_values[it->first] += it->second;
+				}
+			}
+			thread_support.clear();
+
 			
 			verbose=verbose_orig; //switch back to verbose if originally set
 			
 			if (verbose) {
 				end = chrono::high_resolution_clock::now();
-				cout << "\33[2K\r" << "Bootstrapping... (" << util::format_time(end - begin) << ")" << endl << flush;
+				double seconds = chrono::duration<double>(end - bootstrap_begin).count();
+				cout << "\33[2K\r" << "Bootstrapping... (" << util::format_time(end - begin) << "; ";
+				cout << (seconds > 0 ? bootstrap_no / seconds : 0) << " replicates/s)" << endl << flush;
  				cout << "Filtering splits... "<< flush;
 			}
 			
@@ -0,0 +1,112 @@
+#include "reader.h"
+
+#if !defined(_WIN32)
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+
+/**
+ * This constructor maps the given file into memory, if possible.
+ * Gzip-compressed files (magic bytes 1f 8b) are left unmapped.
+ *
+ * @param file_name path to the fasta/fastq file
+ */
+reader::reader(const string& file_name) {
+#if !defined(_WIN32)
+    fd = open(file_name.c_str(), O_RDONLY);
+    if (fd < 0) return;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+        close(fd); fd = -1; return;    // nothing to map
+    }
+    size = info.st_size;
+
+    void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        close(fd); fd = -1; size = 0; return;
+    }
+    data = static_cast<const char*>(map);
+    madvise(map, size, MADV_SEQUENTIAL);    // the file is read once from front to back
+
+    if (size >= 2 && (uint8_t) data[0] == 0x1f && (uint8_t) data[1] == 0x8b) {
+        munmap(map, size); close(fd);    // compressed, has to be streamed
+        fd = -1; data = nullptr; size = 0;
+    }
+#endif
+}
+
+/**
+ * This destructor unmaps the file.
+ */
+reader::~reader() {
+#if !defined(_WIN32)
+    if (data != nullptr) munmap((void*) data, size);
+    if (fd >= 0) close(fd);
+#endif
+}
+
+/**
+ * This function tells whether the file could be mapped into memory.
+ *
+ * @return true, if the file is mapped
+ */
+bool reader::mapped() const {
+    return data != nullptr;
+}
+
+/**
+ * This function returns the next sequence, i.e., all sequence lines up to the next fasta/fastq header.
+ * Lines are processed exactly as in line-wise reading: empty lines are ignored, a line starting with '>' or '@'
+ * ends the current sequence, and a line starting with '+' is skipped together with the following (quality) line.
+ *
+ * @param sequence view on the next sequence
+ * @return false, if there is no further sequence
+ */
+bool reader::next(string_view& sequence) {
+    if (done || data == nullptr) return false;
+
+    const char* begin = nullptr;    // first byte of the sequence in the mapped file
+    const char* end = nullptr;    // behind the last byte of the sequence in the mapped file
+    bool contiguous = true;    // no quality values in between the sequence lines
+    bool buffered = false;    // sequence had to be copied to the buffer
+
+    while (pos < size) {
+        const char* line = data + pos;
+        const char* eol = static_cast<const char*>(memchr(line, '\n', size - pos));
+        size_t length = (eol != nullptr ? eol : data + size) - line;
+        pos += length + (eol != nullptr);
+
+        if (length == 0) continue;    // empty line -> ignore
+
+        if (line[0] == '>' || line[0] == '@') {    // FASTA & FASTQ header -> end of sequence
+            sequence = buffered ? string_view(buffer) : string_view(begin, end - begin);
+            return true;
+        }
+        else if (line[0] == '+') {    // FASTQ quality values -> ignore
+            const char* qual = static_cast<const char*>(memchr(data + pos, '\n', size - pos));
+            pos = (qual != nullptr) ? qual - data + 1 : size;
+            contiguous = false;
+        }
+        else if (begin == nullptr) {    // first sequence line
+            begin = line; end = line + length;
+            contiguous = true;
+        }
+        else if (contiguous) {    // the next line directly follows, extend the view
+            end = line + length;
+        }
+        else {    // sequence continues behind quality values -> copy
+            if (!buffered) {
+                buffer.assign(begin, end - begin);
+                buffered = true;
+            }
+            buffer += '\n';
+            buffer.append(line, length);
+        }
+    }
+    done = true;
+    sequence = buffered ? string_view(buffer) : string_view(begin, end - begin);
+    return true;
+}
@@ -0,0 +1,84 @@
+#ifndef SANS_READER_H
+#define SANS_READER_H
+
+
+#include <string>
+#include <string_view>
+#include <cstring>
+#include <cstdint>
+
+using namespace std;
+
+/**
+ * This class reads the sequences of a fasta/fastq file record by record.
+ * Uncompressed files are memory-mapped, and each sequence is handed out as a view
+ * on the mapped bytes (line breaks included), i.e., without copying any line.
+ */
+class reader {
+
+private:
+
+    /**
+     * This is the file descriptor of the mapped file.
+     */
+    int fd = -1;
+
+    /**
+     * These are the mapped bytes of the file and their number.
+     */
+    const char* data = nullptr;
+    size_t size = 0;
+
+    /**
+     * This is the current position in the mapped file.
+     */
+    size_t pos = 0;
+
+    /**
+     * This indicates that the end of the file has been reported.
+     */
+    bool done = false;
+
+    /**
+     * This buffer holds a sequence that is not contiguous in the file (e.g. interrupted by fastq quality values).
+     */
+    string buffer;
+
+public:
+
+    /**
+     * This constructor maps the given file into memory, if possible.
+     *
+     * @param file_name path to the fasta/fastq file
+     */
+    reader(const string& file_name);
+
+    /**
+     * This destructor unmaps the file.
+     */
+    ~reader();
+
+    reader(const reader&) = delete;
+    reader& operator=(const reader&) = delete;
+
+    /**
+     * This function tells whether the file could be mapped into memory.
+     * Compressed or empty files are not mapped and have to be read as a stream.
+     *
+     * @return true, if the file is mapped
+     */
+    bool mapped() const;
+
+    /**
+     * This function returns the next sequence, i.e., all sequence lines up to the next fasta/fastq header.
+     * As for line-wise reading, the (possibly empty) sequence in front of the first header is returned as well.
+     * The sequence may contain line breaks ('\n'), which have to be skipped by the caller.
+     *
+     * @param sequence view on the next sequence
+     * @return false, if there is no further sequence
+     */
+    bool next(string_view& sequence);
+
+};
+
+#endif
@@ -54,6 +54,54 @@ void util::check_n(uint64_t& n, string& path, const uint64_t& max_N) {
 
 
 
+/**
+ * This function runs the pre-built variant of SANS (see make variants) with the smallest k-mer width (maxK)
+ * that fits the k-mer length, and the smallest color width (maxN) that fits the number of input genomes,
+ * if its widths fit better than the compile parameters DmaxK and DmaxN.
+ * The variants are named SANS-K<maxK>-N<maxN> and placed next to the binary.
+ *
+ * @param argv command line arguments
+ * @param k k-mer length
+ * @param n number of input genomes, or 0 if not known yet
+ * @param max_K compile parameter DmaxK of this binary
+ * @param max_N compile parameter DmaxN of this binary
+ */
+void util::run_variant(char* argv[], const uint64_t& k, const uint64_t& n, const uint64_t& max_K, const uint64_t& max_N) {
+  #if defined(__unix__) || defined(__APPLE__)
+	uint64_t need = n == 0 ? max_N : n;    // number of genomes not known yet
+	uint64_t width_K = 32;    // the smallest pre-built k-mer width for k
+	while (width_K < k) width_K *= 2;
+
+	bool fits_K = k <= max_K && max_K <= width_K;    // the own k-mer width fits
+	bool fits_N = need <= max_N && max_N-need < 100;    // the own color width fits
+	if (fits_K && fits_N) return;
+	uint64_t K = fits_K ? max_K : width_K;
+
+	// the folder of this binary
+	string binary = argv[0];
+	char link[4096];
+	ssize_t length = readlink("/proc/self/exe", link, sizeof(link)-1);
+	if (length > 0) binary.assign(link, length);
+	string folder = binary.find('/') == string::npos ? "." : binary.substr(0, binary.rfind('/'));
+
+	// the own color width if it fits, else the smallest pre-built color width for n genomes
+	vector<uint64_t> widths;
+	if (fits_N) widths.push_back(max_N);
+	for (uint64_t width = 64; width <= 65536; width *= 2) widths.push_back(width);
+
+	for (uint64_t& width : widths) {
+		if (width < need) continue;
+		if (K == max_K && width >= max_N && need <= max_N) return;    // not narrower than the own width
+		string variant = folder + "/SANS-K" + to_string(K) + "-N" + to_string(width);
+		if (access(variant.c_str(), X_OK) != 0) continue;    // not built
+		cout << flush; cerr << flush;
+		execv(variant.c_str(), argv);
+		return;    // could not be run
+	}
+  #endif
+}
+
+
 /**
  * This function calculates the arithmetic mean of two values.
  *
@@ -159,6 +207,57 @@ char util::bits_to_char(const uint64_t& b) {
     }
 }
 
+/**
+ * This function encodes up to 64 characters to two bits each (case-insensitive) and marks the valid bases and line breaks.
+ * The code is ((c >> 1) ^ (c >> 2)) & 3, i.e., A/a -> 0, C/c -> 1, G/g -> 2, T/t -> 3, without branches or table look-ups.
+ * With SSE2/AVX2, 16/32 characters are encoded at once.
+ *
+ * @param chars characters
+ * @param n number of characters (at most 64)
+ * @param codes two-bit code per character (undefined for invalid characters)
+ * @param valid bit i is set, if character i is a base (A, C, G, or T)
+ * @param skip bit i is set, if character i is a line break
+ */
+void util::encode_dna(const char* chars, const uint64_t& n, uint8_t* codes, uint64_t& valid, uint64_t& skip) {
+    uint64_t i = 0;
+    valid = 0; skip = 0;
+#if defined(__AVX2__)
+    for (; i + 32 <= n; i += 32) {
+        __m256i c = _mm256_loadu_si256((const __m256i*) (chars + i));
+        __m256i lower = _mm256_or_si256(c, _mm256_set1_epi8(0x20));    // a letter in lower case
+        __m256i base = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(lower, _mm256_set1_epi8('a')), _mm256_cmpeq_epi8(lower, _mm256_set1_epi8('c'))),
+            _mm256_or_si256(_mm256_cmpeq_epi8(lower, _mm256_set1_epi8('g')), _mm256_cmpeq_epi8(lower, _mm256_set1_epi8('t'))));
+        __m256i code = _mm256_and_si256(    // bits shifted in from the neighboring byte are masked out
+            _mm256_xor_si256(_mm256_srli_epi16(c, 1), _mm256_srli_epi16(c, 2)), _mm256_set1_epi8(0b11));
+        _mm256_storeu_si256((__m256i*) (codes + i), code);
+        valid |= (uint64_t) (uint32_t) _mm256_movemask_epi8(base) << i;
+        skip |= (uint64_t) (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(c, _mm256_set1_epi8('\n'))) << i;
+    }
+#endif
+#if defined(__SSE2__)
+    for (; i + 16 <= n; i += 16) {
+        __m128i c = _mm_loadu_si128((const __m128i*) (chars + i));
+        __m128i lower = _mm_or_si128(c, _mm_set1_epi8(0x20));    // a letter in lower case
+        __m128i base = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(lower, _mm_set1_epi8('a')), _mm_cmpeq_epi8(lower, _mm_set1_epi8('c'))),
+            _mm_or_si128(_mm_cmpeq_epi8(lower, _mm_set1_epi8('g')), _mm_cmpeq_epi8(lower, _mm_set1_epi8('t'))));
+        __m128i code = _mm_and_si128(    // bits shifted in from the neighboring byte are masked out
+            _mm_xor_si128(_mm_srli_epi16(c, 1), _mm_srli_epi16(c, 2)), _mm_set1_epi8(0b11));
+        _mm_storeu_si128((__m128i*) (codes + i), code);
+        valid |= (uint64_t) (uint16_t) _mm_movemask_epi8(base) << i;
+        skip |= (uint64_t) (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(c, _mm_set1_epi8('\n'))) << i;
+    }
+#endif
+    for (; i < n; ++i) {    // scalar fallback and remaining characters
+        uint8_t c = chars[i];
+        uint8_t lower = c | 0x20;
+        codes[i] = ((c >> 1) ^ (c >> 2)) & 0b11;
+        valid |= (uint64_t) (lower == 'a' || lower == 'c' || lower == 'g' || lower == 't') << i;
+        skip |= (uint64_t) (c == '\n') << i;
+    }
+}
+
 
 /**
  * This function encodes a single character to five bits.
@@ -10,6 +10,13 @@
 #include <vector>
 #include <regex>
 #include <sys/stat.h>
+#if defined(__unix__) || defined(__APPLE__)
+    #include <unistd.h>
+#endif
+
+#if defined(__AVX2__) || defined(__SSE2__)
+    #include <immintrin.h>
+#endif
 
 
 using namespace std;
@@ -32,6 +39,20 @@ public:
 	*/ 
 	static void check_n(uint64_t& n, string &path, const uint64_t& max_N);
 
+    /**
+     * This function runs the pre-built variant of SANS (see make variants) with the smallest k-mer width (maxK)
+     * that fits the k-mer length, and the smallest color width (maxN) that fits the number of input genomes,
+     * if its widths fit better than the compile parameters DmaxK and DmaxN.
+     * The process is replaced by the variant, i.e., the function only returns if there is no better variant.
+     *
+     * @param argv command line arguments
+     * @param k k-mer length
+     * @param n number of input genomes, or 0 if not known yet
+     * @param max_K compile parameter DmaxK of this binary
+     * @param max_N compile parameter DmaxN of this binary
+     */
+    static void run_variant(char* argv[], const uint64_t& k, const uint64_t& n, const uint64_t& max_K, const uint64_t& max_N);
+
 
     /**
      * This function calculates the arithmetic mean of two values.
@@ -85,6 +106,17 @@ public:
      */
     static char bits_to_char(const uint64_t& b);
 
+    /**
+     * This function encodes up to 64 characters to two bits each (case-insensitive) and marks the valid bases and line breaks.
+     *
+     * @param chars characters
+     * @param n number of characters (at most 64)
+     * @param codes two-bit code per character (undefined for invalid characters)
+     * @param valid bit i is set, if character i is a base (A, C, G, or T)
+     * @param skip bit i is set, if character i is a line break
+     */
+    static void encode_dna(const char* chars, const uint64_t& n, uint8_t* codes, uint64_t& valid, uint64_t& skip);
+
     /**
      * This function encodes a single character to five bits.
      *